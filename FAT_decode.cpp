@@ -0,0 +1,193 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "FAT_decode.h"
+
+// Kernels are selected at compile time: /arch:AVX2 or -mavx2 enables the AVX2 one, SSE2 is the x86-64 baseline
+#if defined(__AVX2__)
+#define FAT_DECODE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FAT_DECODE_SSE2 1
+#endif
+
+#if defined(FAT_DECODE_AVX2) || defined(FAT_DECODE_SSE2)
+#include <immintrin.h>
+#endif
+
+void decode_FAT12_scalar(const uint8_t* fat, size_t fat_size, uint32_t* next, size_t first_entry) {
+	const size_t entries = FAT12_entries(fat_size);
+	for (size_t i = first_entry; i < entries; ++i) {
+		const size_t pos = i * 3 / 2;
+		uint32_t word = fat[pos];
+		if (pos + 1 < fat_size)
+			word |= static_cast<uint32_t>(fat[pos + 1]) << 8;
+		// Lower 12 bits for the even entries, upper -- for the odd
+		next[i] = ((i % 2) ? (word >> 4) : word) & 0x0FFF;
+	}
+}
+
+void decode_FAT16_scalar(const uint8_t* fat, size_t fat_size, uint32_t* next, size_t first_entry) {
+	const size_t entries = fat_size / 2;
+	for (size_t i = first_entry; i < entries; ++i) {
+		next[i] = fat[2 * i] | (static_cast<uint32_t>(fat[2 * i + 1]) << 8);
+	}
+}
+
+// Each 3 bytes hold two FAT12 entries: bytes are gathered into 32-bit lanes by triples,
+// then the even entry is the lower 12 bits of the lane, the odd one -- the next 12 bits.
+void decode_FAT12(const uint8_t* fat, size_t fat_size, uint32_t* next) {
+	size_t i = 0; // Entry; the loops below advance it by the whole triples
+#if defined(FAT_DECODE_AVX2)
+	{
+		const __m256i triples = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i mask = _mm256_set1_epi32(0x0FFF);
+		// 16 entries from 24 bytes, the second 16-byte load ends at 28
+		for (; i / 2 * 3 + 28 <= fat_size; i += 16) {
+			const uint8_t* src = fat + i / 2 * 3;
+			const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+			const __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			const __m256i groups = _mm256_shuffle_epi8(bytes, triples);
+			const __m256i even = _mm256_and_si256(groups, mask);
+			const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(groups, 12), mask);
+			const __m256i first = _mm256_unpacklo_epi32(even, odd);  // 0-3 | 8-11
+			const __m256i second = _mm256_unpackhi_epi32(even, odd); // 4-7 | 12-15
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(next + i), _mm256_permute2x128_si256(first, second, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(next + i + 8), _mm256_permute2x128_si256(first, second, 0x31));
+		}
+	}
+#endif
+#if defined(FAT_DECODE_SSE2)
+	{
+		const __m128i mask = _mm_set1_epi32(0x0FFF);
+		// 8 entries from 12 bytes, loaded by 16
+		for (; i / 2 * 3 + 16 <= fat_size; i += 8) {
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fat + i / 2 * 3));
+			// No byte shuffle in SSE2 -- triples are moved to the lane 0 by the byte shifts
+			const __m128i groups01 = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+			const __m128i groups23 = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9));
+			const __m128i groups = _mm_unpacklo_epi64(groups01, groups23);
+			const __m128i even = _mm_and_si128(groups, mask);
+			const __m128i odd = _mm_and_si128(_mm_srli_epi32(groups, 12), mask);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(next + i), _mm_unpacklo_epi32(even, odd));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(next + i + 4), _mm_unpackhi_epi32(even, odd));
+		}
+	}
+#endif
+	decode_FAT12_scalar(fat, fat_size, next, i);
+}
+
+void decode_FAT16(const uint8_t* fat, size_t fat_size, uint32_t* next) {
+	size_t i = 0;
+#if defined(FAT_DECODE_AVX2)
+	for (; 2 * i + 16 <= fat_size; i += 8) {
+		const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fat + 2 * i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(next + i), _mm256_cvtepu16_epi32(words));
+	}
+#elif defined(FAT_DECODE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; 2 * i + 16 <= fat_size; i += 8) {
+		const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fat + 2 * i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(next + i), _mm_unpacklo_epi16(words, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(next + i + 4), _mm_unpackhi_epi16(words, zero));
+	}
+#endif
+	decode_FAT16_scalar(fat, fat_size, next, i);
+}
+
+namespace {
+	constexpr size_t dir_record_size = 32;
+	constexpr size_t dir_attr_offset = 11;
+	constexpr uint8_t attr_volume_ID = 0x08;
+	constexpr uint8_t attr_long_name = 0x0F;
+	constexpr uint8_t deleted_mark = 0xE5;
+
+	//! Same conditions as FATxx_dir_entry_t::is_dir_record_*() and FAT_attrib_t::is_invalid()
+	bool is_visited(uint8_t first, uint8_t attr) {
+		if (attr == attr_long_name || attr == attr_volume_ID)
+			return true;
+		const bool invalid_attr = (attr & 0xC0) != 0 || (attr & attr_volume_ID) != 0;
+		return first != deleted_mark && first > 0x20 && !invalid_attr;
+	}
+}
+
+size_t classify_dir_records_scalar(const uint8_t* records, size_t count, uint64_t* visit_mask, size_t first_record) {
+	for (size_t i = first_record; i < count; ++i) {
+		const uint8_t* record = records + i * dir_record_size;
+		if (i % 64 == 0)
+			visit_mask[i / 64] = 0;
+		if (record[0] == 0)
+			return i;
+		if (is_visited(record[0], record[dir_attr_offset]))
+			visit_mask[i / 64] |= uint64_t{ 1 } << (i % 64);
+	}
+	return count;
+}
+
+// Records are 32 bytes apart, so the first name byte and the attribute of 16 records are gathered by the dword
+// transposes and packs into two vectors, then classified by the byte compares.
+size_t classify_dir_records(const uint8_t* records, size_t count, uint64_t* visit_mask) {
+	size_t i = 0;
+#if defined(FAT_DECODE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i byte_mask = _mm_set1_epi32(0xFF);
+	for (; i + 16 <= count; i += 16) {
+		__m128i firsts[4], attrs[4];
+		for (size_t quad = 0; quad < 4; ++quad) {
+			const uint8_t* src = records + (i + quad * 4) * dir_record_size;
+			const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + dir_record_size));
+			const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * dir_record_size));
+			const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * dir_record_size));
+			const __m128i lo01 = _mm_unpacklo_epi32(r0, r1), lo23 = _mm_unpacklo_epi32(r2, r3);
+			const __m128i hi01 = _mm_unpackhi_epi32(r0, r1), hi23 = _mm_unpackhi_epi32(r2, r3);
+			firsts[quad] = _mm_and_si128(_mm_unpacklo_epi64(lo01, lo23), byte_mask); // Bytes 0-3 of the records
+			attrs[quad] = _mm_srli_epi32(_mm_unpacklo_epi64(hi01, hi23), 24);        // Bytes 8-11
+		}
+		const __m128i first = _mm_packus_epi16(_mm_packs_epi32(firsts[0], firsts[1]), _mm_packs_epi32(firsts[2], firsts[3]));
+		const __m128i attr = _mm_packus_epi16(_mm_packs_epi32(attrs[0], attrs[1]), _mm_packs_epi32(attrs[2], attrs[3]));
+
+		const __m128i is_free = _mm_cmpeq_epi8(first, zero);
+		const __m128i is_LFN = _mm_cmpeq_epi8(attr, _mm_set1_epi8(attr_long_name));
+		const __m128i is_label = _mm_cmpeq_epi8(attr, _mm_set1_epi8(attr_volume_ID));
+		const __m128i is_deleted = _mm_cmpeq_epi8(first, _mm_set1_epi8(static_cast<char>(deleted_mark)));
+		const __m128i is_control = _mm_cmpeq_epi8(_mm_max_epu8(first, _mm_set1_epi8(0x20)), _mm_set1_epi8(0x20)); // <= 0x20
+		const __m128i invalid_attr = _mm_xor_si128(_mm_cmpeq_epi8(_mm_and_si128(attr, _mm_set1_epi8(static_cast<char>(0xC0 | attr_volume_ID))), zero),
+			_mm_set1_epi8(-1));
+		const __m128i skipped = _mm_or_si128(_mm_or_si128(is_deleted, is_control), invalid_attr);
+		const __m128i visited = _mm_or_si128(_mm_or_si128(is_LFN, is_label), _mm_andnot_si128(skipped, _mm_set1_epi8(-1)));
+
+		const auto free_bits = static_cast<uint32_t>(_mm_movemask_epi8(is_free));
+		auto visit_bits = static_cast<uint64_t>(_mm_movemask_epi8(visited));
+		if (i % 64 == 0)
+			visit_mask[i / 64] = 0;
+		if (free_bits != 0) {
+			const size_t first_free = static_cast<size_t>(std::countr_zero(free_bits));
+			visit_bits &= (uint64_t{ 1 } << first_free) - 1;
+			visit_mask[i / 64] |= visit_bits << (i % 64);
+			return i + first_free;
+		}
+		visit_mask[i / 64] |= visit_bits << (i % 64);
+	}
+#endif
+	return classify_dir_records_scalar(records, count, visit_mask, i);
+}
+
+const char* FAT_decode_kernel_name() {
+#if defined(FAT_DECODE_AVX2)
+	return "AVX2";
+#elif defined(FAT_DECODE_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef FAT_DECODE_H_INCLUDED
+#define FAT_DECODE_H_INCLUDED
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+//! Unpacking of the FAT12/FAT16 tables into the flat next-cluster arrays, so walking the chain is a single
+//! indexed load instead of the unaligned 16-bit load, shift and mask per step.
+//! Vectorized with AVX2 or SSE2, when the build targets them, scalar otherwise.
+
+//! Number of FAT12 entries whose first byte is inside the fat_size bytes
+inline size_t FAT12_entries(size_t fat_size) {
+	return fat_size / 3 * 2 + fat_size % 3;
+}
+
+//! Writes FAT12_entries(fat_size) values to next. Bytes past the fat_size are treated as zeros.
+void decode_FAT12(const uint8_t* fat, size_t fat_size, uint32_t* next);
+//! Writes fat_size / 2 values to next
+void decode_FAT16(const uint8_t* fat, size_t fat_size, uint32_t* next);
+
+//! Reference implementations, used for the tails and by the benchmark
+void decode_FAT12_scalar(const uint8_t* fat, size_t fat_size, uint32_t* next, size_t first_entry = 0);
+void decode_FAT16_scalar(const uint8_t* fat, size_t fat_size, uint32_t* next, size_t first_entry = 0);
+
+//! "AVX2", "SSE2" or "scalar"
+const char* FAT_decode_kernel_name();
+
+//! Bulk pre-pass of the directory scanning: classifies 32-byte records by the first name byte and the attribute.
+//! Returns the index of the first free record (end of the directory), or count if there is none. For the records
+//! before it, sets bits in the visit_mask (count/64 words, rounded up) for the ones the scanner should process:
+//! LFN parts, volume labels and the candidates for the files and directories. Deleted records, ones with the
+//! control characters as the first name byte or with invalid attributes are not set -- they are only skipped
+//! by the scanner, breaking the LFN sequence.
+size_t classify_dir_records(const uint8_t* records, size_t count, uint64_t* visit_mask);
+size_t classify_dir_records_scalar(const uint8_t* records, size_t count, uint64_t* visit_mask, size_t first_record = 0);
+
+//! Index of the first set bit in [from, end) of the mask, or end
+inline size_t find_next_bit(const uint64_t* mask, size_t from, size_t end) {
+	while (from < end) {
+		const uint64_t word = mask[from / 64] >> (from % 64);
+		if (word != 0)
+			return std::min(from + static_cast<size_t>(std::countr_zero(word)), end);
+		from = (from / 64 + 1) * 64;
+	}
+	return end;
+}
+
+#endif
@@ -296,7 +296,7 @@ struct FATxx_dir_entry_t
 
 	//! Returns number of invalid chars
 	template<typename T>
-	uint32_t dir_entry_name_to_str(T& name, bool process_OS2_EA_file = true);
+	uint32_t dir_entry_name_to_str(T& name, bool process_OS2_EA_file = true) const;
 
 	bool process_E5();
 
@@ -346,7 +346,7 @@ inline bool FATxx_dir_entry_t::process_E5() {
 }
 
 template<typename T>
-uint32_t FATxx_dir_entry_t::dir_entry_name_to_str(T& name, bool process_OS2_EA_file) {
+uint32_t FATxx_dir_entry_t::dir_entry_name_to_str(T& name, bool process_OS2_EA_file) const {
 	uint32_t invalid = 0;
 
 	auto ea_os2_found = memcmp(&DIR_Name[0], OS2_EA_file_entry, 11);
@@ -420,18 +420,16 @@ struct VFAT_LFN_dir_entry_t
 		return LFN_index & (1 << 6);
 	}
 
-	static constexpr char non_valid_chars_LFN[] = R"("*/:<>?\|)";
-	static int is_valid_char_LFN(char mychar)
-	{
-		return !((mychar >= '\x00') && (mychar < '\x20')) && // Space allowed 
-			strchr(non_valid_chars_LFN, mychar) == nullptr;
+	//! Position of the part in the name, 1 -- for the first 13 symbols. Records are stored in the reverse order.
+	uint32_t get_LFN_ordinal() const {
+		return LFN_index & 0x1F;
 	}
+	static constexpr uint32_t max_LFN_ordinal = 20; // 255 symbols
 
-	//! TODO: no space character at the start or end, and no period at the end.
-	template<typename T>
-	uint32_t dir_LFN_entry_to_ASCII_str(T& name) const {
+	//! Copies the UCS-2 symbols of the part, up to the terminating 0 or the 0xFFFF padding. 
+	//! Returns their number; sets wrong_symbol if stopped by the padding.
+	uint32_t get_LFN_part(wchar_t* ucs16_part, bool& wrong_symbol) const {
 		wchar_t ucs16_record[LFN_name_part_size] = { 0 };
-		char    local_record[LFN_name_part_size + 1] = { 0 };
 		uint32_t idx = 0;
 		for (uint32_t i = 0; i < LFN_name_part1_size; ++i, ++idx)
 			ucs16_record[idx] = LFN_name_part1[i];
@@ -439,17 +437,34 @@ struct VFAT_LFN_dir_entry_t
 			ucs16_record[idx] = LFN_name_part2[i];
 		for (uint32_t i = 0; i < LFN_name_part3_size; ++i, ++idx)
 			ucs16_record[idx] = LFN_name_part3[i];
-		idx = 0;
-		int wrong_symbol = 0;
+		wrong_symbol = false;
 		for (idx = 0; idx < LFN_name_part_size; ++idx) {
 			if (ucs16_record[idx] == 0)
 				break;
 			if (ucs16_record[idx] == 0xFFFF) {
-				wrong_symbol = 1;
+				wrong_symbol = true;
 				break;
-			}		
+			}
+			ucs16_part[idx] = ucs16_record[idx];
 		}
-		auto res = ucs16_to_local(local_record, ucs16_record, idx); //-V106
+		return idx;
+	}
+
+	static constexpr char non_valid_chars_LFN[] = R"("*/:<>?\|)";
+	static int is_valid_char_LFN(char mychar)
+	{
+		return !((mychar >= '\x00') && (mychar < '\x20')) && // Space allowed 
+			strchr(non_valid_chars_LFN, mychar) == nullptr;
+	}
+
+	//! TODO: no space character at the start or end, and no period at the end.
+	template<typename T>
+	uint32_t dir_LFN_entry_to_ASCII_str(T& name) const {
+		wchar_t ucs16_record[LFN_name_part_size] = { 0 };
+		char    local_record[2 * LFN_name_part_size + 1] = { 0 }; // Up to two bytes per symbol for DBCS
+		bool wrong_symbol = false;
+		uint32_t idx = get_LFN_part(ucs16_record, wrong_symbol);
+		auto res = ucs16_to_local(local_record, sizeof(local_record) - 1, ucs16_record, idx); //-V106
 		if (res != 0)
 			return res;
 		else {
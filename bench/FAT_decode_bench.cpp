@@ -0,0 +1,150 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+// Microbenchmark of the FAT12/16 chain walking: the per-step unpacking of the packed FAT, as
+// FAT_image_t::next_cluster_FAT12() does it, against the pre-decoded next-cluster array.
+// Build with -DFATIMG_BUILD_BENCHMARKS=ON, run: FAT_decode_bench [repetitions]
+
+#include "FAT_decode.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+	enum FAT_types { FAT12_type = 1, FAT16_type = 2 };
+
+	// Copy of the scalar path: switch by the FAT type on each step, unaligned word load, shift and mask
+	uint32_t next_cluster_packed(const std::vector<uint8_t>& fat, int FAT_type, uint32_t cluster) {
+		switch (FAT_type) {
+		case FAT12_type: {
+			const uint8_t* pos = fat.data() + ((cluster * 3) >> 1);
+			if (pos >= fat.data() + fat.size())
+				return 0xFF6;
+			uint16_t word;
+			std::memcpy(&word, pos, sizeof(word));
+			return (word >> ((cluster % 2) ? 4 : 0)) & 0x0FFF;
+		}
+		case FAT16_type: {
+			size_t pos = static_cast<size_t>(cluster) * 2;
+			if (pos + 2 > fat.size())
+				return 0xFFF6;
+			uint16_t word;
+			std::memcpy(&word, fat.data() + pos, sizeof(word));
+			return word;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	//! Single chain through all the clusters in the random order, as a worst-case fragmented volume
+	std::vector<uint8_t> make_FAT(int FAT_type, uint32_t clusters, uint32_t end_of_chain, std::mt19937& rng) {
+		std::vector<uint32_t> order(clusters - 2);
+		std::iota(order.begin(), order.end(), 2u);
+		std::shuffle(order.begin(), order.end(), rng);
+		std::vector<uint32_t> next(clusters, 0);
+		for (size_t i = 0; i + 1 < order.size(); ++i)
+			next[order[i]] = order[i + 1];
+		next[order.back()] = end_of_chain;
+		next[0] = order.front(); // Start of the walk
+		std::vector<uint8_t> fat((FAT_type == FAT12_type ? (clusters * 3 + 1) / 2 : clusters * 2) + 1, 0);
+		for (uint32_t c = 0; c < clusters; ++c) {
+			if (FAT_type == FAT12_type) {
+				uint8_t* pos = fat.data() + c * 3 / 2;
+				uint16_t word;
+				std::memcpy(&word, pos, sizeof(word));
+				word = (c % 2) ? static_cast<uint16_t>((word & 0x000F) | (next[c] << 4)) :
+					static_cast<uint16_t>((word & 0xF000) | next[c]);
+				std::memcpy(pos, &word, sizeof(word));
+			}
+			else {
+				fat[2 * c] = static_cast<uint8_t>(next[c]);
+				fat[2 * c + 1] = static_cast<uint8_t>(next[c] >> 8);
+			}
+		}
+		fat.pop_back(); // Padding for the word access above
+		return fat;
+	}
+
+	template<typename F>
+	double best_ns(int repetitions, const F& f) {
+		double best = 1e300;
+		for (int i = 0; i < repetitions; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			f();
+			auto end = std::chrono::steady_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+		}
+		return best;
+	}
+
+	volatile uint32_t sink;
+
+	bool run(const char* name, int FAT_type, uint32_t clusters, int repetitions, std::mt19937& rng) {
+		const uint32_t end_of_chain = FAT_type == FAT12_type ? 0xFFF : 0xFFFF;
+		const auto fat = make_FAT(FAT_type, clusters, end_of_chain, rng);
+		const size_t entries = FAT_type == FAT12_type ? FAT12_entries(fat.size()) : fat.size() / 2;
+		std::vector<uint32_t> next(entries), reference(entries);
+
+		auto decode = FAT_type == FAT12_type ? decode_FAT12 : decode_FAT16;
+		auto decode_scalar = [FAT_type](const uint8_t* f, size_t size, uint32_t* out) {
+			if (FAT_type == FAT12_type)
+				decode_FAT12_scalar(f, size, out);
+			else
+				decode_FAT16_scalar(f, size, out);
+			};
+		decode_scalar(fat.data(), fat.size(), reference.data());
+		decode(fat.data(), fat.size(), next.data());
+		if (next != reference) {
+			std::printf("%s: %s decoding differs from the scalar one\n", name, FAT_decode_kernel_name());
+			return false;
+		}
+
+		const volatile int type = FAT_type; // Not known at compile time, as in the plugin
+		const double walk_packed = best_ns(repetitions, [&] {
+			uint32_t steps = 0;
+			for (uint32_t c = next_cluster_packed(fat, type, 0); c < end_of_chain - 7; c = next_cluster_packed(fat, type, c))
+				++steps;
+			sink = steps;
+			});
+		const double walk_decoded = best_ns(repetitions, [&] {
+			uint32_t steps = 0;
+			for (uint32_t c = next[0]; c < end_of_chain - 7; c = next[c])
+				++steps;
+			sink = steps;
+			});
+		const double decode_scalar_ns = best_ns(repetitions, [&] { decode_scalar(fat.data(), fat.size(), next.data()); });
+		const double decode_ns = best_ns(repetitions, [&] { decode(fat.data(), fat.size(), next.data()); });
+
+		const double steps = clusters - 2;
+		std::printf("%s, %u clusters:\n", name, clusters);
+		std::printf("  chain walk, packed FAT:   %8.2f ns/step\n", walk_packed / steps);
+		std::printf("  chain walk, decoded FAT:  %8.2f ns/step\n", walk_decoded / steps);
+		std::printf("  decode, scalar:           %8.2f ns/entry, %10.0f ns total\n", decode_scalar_ns / entries, decode_scalar_ns);
+		std::printf("  decode, %-6s            %8.2f ns/entry, %10.0f ns total\n", FAT_decode_kernel_name(), decode_ns / entries, decode_ns);
+		if (walk_packed > walk_decoded)
+			std::printf("  decoding pays off after %.2f full-chain walks\n", decode_ns / (walk_packed - walk_decoded));
+		else
+			std::printf("  decoding does not pay off\n");
+		return true;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const int repetitions = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50;
+	std::mt19937 rng(12345);
+	bool ok = run("FAT12 floppy", FAT12_type, 2880, repetitions, rng);
+	ok = run("FAT12 largest", FAT12_type, 4084, repetitions, rng) && ok;
+	ok = run("FAT16 largest", FAT16_type, 65524, repetitions, rng) && ok;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
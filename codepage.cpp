@@ -0,0 +1,94 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "codepage.h"
+#include "ff.h"
+
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CODEPAGE_SSE2 1
+#include <immintrin.h>
+#endif
+
+codepage_table_t::codepage_table_t(char unmapped_char) :
+	table_m(new char[table_size]), unmapped_char_m(unmapped_char)
+{
+	for (size_t i = 0; i < 0x80; ++i)
+		table_m[i] = static_cast<char>(i);
+	std::memset(table_m.get() + 0x80, unmapped_char, table_size - 0x80);
+}
+
+// Blocks of 8 symbols are checked to be ASCII at once and packed to bytes, others go through the table
+void codepage_table_t::convert(char* outstr, const wchar_t* instr, size_t len) const {
+	size_t i = 0;
+#if defined(CODEPAGE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i non_ASCII = _mm_set1_epi16(static_cast<short>(0xFF80));
+	for (; i + 8 <= len; i += 8) {
+		__m128i symbols;
+		if constexpr (sizeof(wchar_t) == 2) {
+			symbols = _mm_loadu_si128(reinterpret_cast<const __m128i*>(instr + i));
+		}
+		else { // 32-bit wchar_t of the POSIX hosts: saturation keeps the non-ASCII ones non-ASCII
+			const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(instr + i));
+			const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(instr + i + 4));
+			symbols = _mm_packs_epi32(lo, hi);
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(symbols, non_ASCII), zero)) == 0xFFFF) {
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(outstr + i), _mm_packus_epi16(symbols, symbols));
+		}
+		else {
+			for (size_t j = i; j < i + 8; ++j)
+				outstr[j] = to_local(instr[j]);
+		}
+	}
+#endif
+	for (; i < len; ++i)
+		outstr[i] = to_local(instr[i]);
+}
+
+namespace {
+	std::unique_ptr<codepage_table_t> make_FatFS_OEM_table() {
+#if FF_CODE_PAGE != 0 && FF_CODE_PAGE < 900
+		try {
+			auto table = std::make_unique<codepage_table_t>('\0');
+			char* data = table->data();
+			// Several OEM codes can map to the same symbol -- the lowest one wins, as in the linear search
+			for (WCHAR oem = 0xFF; oem >= 0x80; --oem) {
+				const WCHAR uni = ff_oem2uni(oem, FF_CODE_PAGE);
+				if (uni >= 0x80)
+					data[uni] = static_cast<char>(oem);
+			}
+			return table;
+		}
+		catch (std::bad_alloc&) {
+			return nullptr;
+		}
+#else
+		return nullptr;
+#endif
+	}
+}
+
+const codepage_table_t* get_FatFS_OEM_table() {
+	static const std::unique_ptr<codepage_table_t> table = make_FatFS_OEM_table();
+	return table.get();
+}
+
+extern "C" {
+	int ff_uni2oem_table(DWORD uni, WCHAR* oem) {
+		const codepage_table_t* table = get_FatFS_OEM_table();
+		if (table == nullptr)
+			return 0;
+		*oem = static_cast<uint8_t>(table->to_local(static_cast<wchar_t>(uni)));
+		return 1;
+	}
+}
@@ -0,0 +1,48 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef CODEPAGE_H_INCLUDED
+#define CODEPAGE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+//! UCS-2 to the single-byte code page conversion by the 64K-entry lookup table: each UCS-2 symbol is
+//! its own index. ASCII runs are passed through by the vectorized path, without touching the table.
+//! Tables are built once per process, on the first use -- see the get_*_table() functions.
+class codepage_table_t {
+public:
+	static constexpr size_t table_size = 0x10000;
+
+	//! ASCII is mapped to itself, everything else -- to the unmapped_char. Throws std::bad_alloc.
+	explicit codepage_table_t(char unmapped_char = '?');
+
+	//! For filling the table by the builders
+	char* data() { return table_m.get(); }
+
+	char to_local(wchar_t wc) const {
+		const auto code = static_cast<uint32_t>(wc);
+		return code < table_size ? table_m[code] : unmapped_char_m;
+	}
+	//! Converts exactly len symbols, no terminating zero is added
+	void convert(char* outstr, const wchar_t* instr, size_t len) const;
+
+private:
+	std::unique_ptr<char[]> table_m;
+	char unmapped_char_m;
+};
+
+//! UCS-2 to the OEM code page of the FatFS (FF_CODE_PAGE), the reverse of its ff_oem2uni() table.
+//! Unmapped symbols are converted to 0, as ff_uni2oem() does. nullptr for the DBCS code pages or if
+//! the table could not be allocated.
+const codepage_table_t* get_FatFS_OEM_table();
+//! Its C interface for ffunicode.c, ff_uni2oem_table(), is declared in ff.h
+
+#endif
@@ -0,0 +1,100 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "copy_pipeline.h"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+copy_pipeline_t::copy_pipeline_t(size_t buffers, size_t buffer_size) {
+	buffers = std::max<size_t>(buffers, 1);
+	buffers_m.reserve(buffers);
+	for (size_t i = 0; i < buffers; ++i) {
+		buffers_m.push_back(std::make_unique_for_overwrite<char[]>(buffer_size));
+	}
+}
+
+int copy_pipeline_t::run_serial(size_t chunks, const read_chunk_t& read_chunk, const write_chunk_t& write_chunk) {
+	char* buffer = buffers_m.front().get();
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		int res = read_chunk(chunk, buffer);
+		if (res != 0)
+			return res;
+		res = write_chunk(chunk, buffer);
+		if (res != 0)
+			return res;
+	}
+	return 0;
+}
+
+void copy_pipeline_t::reader_loop(size_t chunks, const read_chunk_t& read_chunk) {
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		char* buffer = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mux);
+			cv.wait(lock, [this] { return stop_m || !free_m.empty(); });
+			if (stop_m)
+				return;
+			buffer = free_m.back();
+			free_m.pop_back();
+		}
+		int res = read_chunk(chunk, buffer);
+		{
+			std::lock_guard<std::mutex> lock(mux);
+			filled_m.push_back({ chunk, buffer, res });
+		}
+		cv.notify_all();
+		if (res != 0) // Writer stops at this chunk
+			return;
+	}
+}
+
+int copy_pipeline_t::run(size_t chunks, const read_chunk_t& read_chunk, const write_chunk_t& write_chunk) {
+	if (buffers_m.size() < 2 || chunks < 2) {
+		return run_serial(chunks, read_chunk, write_chunk);
+	}
+	free_m.clear();
+	filled_m.clear();
+	stop_m = false;
+	for (auto& buffer : buffers_m) {
+		free_m.push_back(buffer.get());
+	}
+	std::thread reader;
+	try {
+		reader = std::thread(&copy_pipeline_t::reader_loop, this, chunks, std::cref(read_chunk));
+	}
+	catch (std::system_error&) {
+		return run_serial(chunks, read_chunk, write_chunk);
+	}
+
+	int res = 0;
+	for (size_t chunk = 0; chunk < chunks && res == 0; ++chunk) {
+		filled_t filled;
+		{
+			std::unique_lock<std::mutex> lock(mux);
+			cv.wait(lock, [this] { return !filled_m.empty(); });
+			filled = filled_m.front();
+			filled_m.pop_front();
+		}
+		res = filled.error;
+		if (res == 0) {
+			res = write_chunk(filled.chunk, filled.buffer);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mux);
+			free_m.push_back(filled.buffer);
+			if (res != 0)
+				stop_m = true;
+		}
+		cv.notify_all();
+	}
+	reader.join();
+	return res;
+}
@@ -0,0 +1,59 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef COPY_PIPELINE_H_INCLUDED
+#define COPY_PIPELINE_H_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//! Copies the data by chunks, reading the next chunks in a separate thread while the current one is written,
+//! so the source and destination devices work at the same time (image on the network share, file on the local disk).
+//! Number of chunks in flight is bounded by the number of buffers. Writes are done in the calling thread, in order,
+//! so the callbacks, like the Total Commander progress one, could be called from the write stage.
+class copy_pipeline_t {
+public:
+	//! Fills the buffer with the given chunk, returns 0 or error code (E_*)
+	using read_chunk_t = std::function<int(size_t chunk, char* buffer)>;
+	//! Consumes the chunk, returns 0 or error code (E_*), E_EABORTED to cancel
+	using write_chunk_t = std::function<int(size_t chunk, const char* buffer)>;
+
+	//! Throws std::bad_alloc. Less than two buffers -- no pipelining, chunks are read and written in turn.
+	copy_pipeline_t(size_t buffers, size_t buffer_size);
+	copy_pipeline_t(const copy_pipeline_t&) = delete;
+	copy_pipeline_t& operator=(const copy_pipeline_t&) = delete;
+
+	//! Returns 0 or the error code of the first failed chunk; the chunks before it are written.
+	//! Falls back to the serial copy if the reader thread could not be started.
+	int run(size_t chunks, const read_chunk_t& read_chunk, const write_chunk_t& write_chunk);
+
+private:
+	struct filled_t {
+		size_t chunk;
+		char* buffer;
+		int error;
+	};
+
+	int run_serial(size_t chunks, const read_chunk_t& read_chunk, const write_chunk_t& write_chunk);
+	void reader_loop(size_t chunks, const read_chunk_t& read_chunk);
+
+	std::vector<std::unique_ptr<char[]>> buffers_m;
+	std::mutex mux;
+	std::condition_variable cv;
+	std::vector<char*> free_m;
+	std::deque<filled_t> filled_m;
+	bool stop_m = false; // Writer failed, reader should not start new chunks
+};
+
+#endif
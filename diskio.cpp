@@ -9,24 +9,96 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
-#include <map>
-//#include <mutex>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "minimal_fixed_string.h"
 #include "sysio_winapi.h"
 #include "plugin_config.h"
+#include "sector_cache.h"
+#include "image_file.h"
 
 #include "ff.h"			/* Obtains integer types */
 #include "diskio.h"		/* Declarations of disk functions */
 
 
+//! Drive table slot. Fields other than state are written only under disk_descriptors_mux while
+//! the slot is not disk_ready, and are read-only afterwards -- so the sector I/O needs no locking.
 struct disk_descriptor_t {
-    FILE* file;          
-    minimal_fixed_string_t<MAX_PATH> PathName;
-    size_t boot_sector_offset;
+    static constexpr uint8_t disk_free  = 0;
+    static constexpr uint8_t disk_busy  = 1; // Being registered or unregistered
+    static constexpr uint8_t disk_ready = 2;
+
+    std::atomic<uint8_t> state{ disk_free };
+    uint32_t generation = 0;  // Incremented on each registration of the slot
+    image_file_ptr_t image;   // Shared with the layout probing in PackFiles()/DeleteFiles()
+    uint64_t boot_sector_offset = 0;
 };
 
-//std::mutex disk_deskriptors_mux;
-std::map<BYTE, disk_descriptor_t> disk_descriptors; 
+std::mutex disk_descriptors_mux;
+std::array<disk_descriptor_t, FF_VOLUMES> disk_descriptors;
+
+namespace {
+    static_assert(sector_cache_t::sector_size == FF_MIN_SS, "Sector cache expects FF_MIN_SS sectors");
+
+    //! Returns descriptor of the ready drive or nullptr
+    disk_descriptor_t* get_ready_disk(BYTE pdrv) {
+        if (pdrv >= disk_descriptors.size())
+            return nullptr;
+        auto& descr = disk_descriptors[pdrv];
+        if (descr.state.load(std::memory_order_acquire) != disk_descriptor_t::disk_ready)
+            return nullptr;
+        return &descr;
+    }
+
+    //! Raw sector I/O, used by the cache. Descriptor is validated by the callers.
+    bool raw_read_sectors(uint8_t pdrv, uint8_t* buff, uint64_t sector, size_t count) {
+        const auto& descr = disk_descriptors[pdrv];
+        uint64_t offset = sector * FF_MIN_SS + descr.boot_sector_offset;
+        auto read_s = read_file_at(descr.image->handle, buff, count * FF_MIN_SS, offset);
+        if (read_s != count * FF_MIN_SS) {
+            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- image \'%s\' read error."
+                " Requested %zu sectors at LBA %llu, read %zu bytes",
+                pdrv, descr.image->path.data(), count, static_cast<unsigned long long>(sector), read_s);
+            return false;
+        }
+        return true;
+    }
+
+    bool raw_write_sectors(uint8_t pdrv, const uint8_t* buff, uint64_t sector, size_t count) {
+        const auto& descr = disk_descriptors[pdrv];
+        uint64_t offset = sector * FF_MIN_SS + descr.boot_sector_offset;
+        auto written_s = write_file_at(descr.image->handle, buff, count * FF_MIN_SS, offset);
+        if (written_s != count * FF_MIN_SS) {
+            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- image \'%s\' write error."
+                " Requested %zu sectors at LBA %llu, written %zu bytes",
+                pdrv, descr.image->path.data(), count, static_cast<unsigned long long>(sector), written_s);
+            return false;
+        }
+        return true;
+    }
+
+    bool raw_write_sectors_gather(uint8_t pdrv, const uint8_t* const* buffs, uint64_t sector, size_t count) {
+        const auto& descr = disk_descriptors[pdrv];
+        uint64_t offset = sector * FF_MIN_SS + descr.boot_sector_offset;
+        std::vector<io_segment_t> segments(count);
+        for (size_t i = 0; i < count; ++i) {
+            segments[i] = { buffs[i], FF_MIN_SS };
+        }
+        auto written_s = write_file_gather_at(descr.image->handle, segments.data(), count, offset);
+        if (written_s != count * FF_MIN_SS) {
+            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- image \'%s\' gathering write error."
+                " Requested %zu sectors at LBA %llu, written %zu bytes",
+                pdrv, descr.image->path.data(), count, static_cast<unsigned long long>(sector), written_s);
+            return false;
+        }
+        return true;
+    }
+
+    sector_cache_t sector_cache{ raw_read_sectors, raw_write_sectors, raw_write_sectors_gather };
+}
 
 
 extern "C" {
@@ -42,29 +114,47 @@ extern "C" {
     DSTATUS disk_initialize(
         BYTE pdrv,				/* Physical drive nmuber to identify the drive */
         const char* image_path,
-		size_t boot_sector_offset	/* Offset to the boot sector in the image file (in bytes) */
+		QWORD boot_sector_offset	/* Offset to the boot sector in the image file (in bytes) */
     )
     {
         plugin_config.log_print_dbg("Info# Initializing disk %d, for filename %s, in disk_initialize",
             pdrv, image_path);
 
-        if (disk_descriptors.count(pdrv) > 0) {
+        if (pdrv >= disk_descriptors.size()) {
+            plugin_config.log_print_dbg("Warning# in disk_initialize, disk %d -- no such driver.", pdrv);
+            return STA_NOINIT;
+        }
+
+        std::lock_guard<std::mutex> lock(disk_descriptors_mux);
+        auto& descr = disk_descriptors[pdrv];
+        if (descr.state.load(std::memory_order_relaxed) != disk_descriptor_t::disk_free) {
             plugin_config.log_print_dbg("Warning# in disk_initialize, disk %d, for filename %s, already opened",
                 pdrv, image_path);
             return STA_PROTECT; 
         }
 
-        disk_descriptors[pdrv] = { nullptr, image_path, boot_sector_offset };
-
-        FILE* fp = fopen(image_path, "rb+");
-        disk_descriptors[pdrv] = { fp, image_path, boot_sector_offset };
+        // Cache could be resized only when no other disk uses it
+        bool no_disks = std::all_of(disk_descriptors.begin(), disk_descriptors.end(), [](const auto& d) {
+            return d.state.load(std::memory_order_relaxed) == disk_descriptor_t::disk_free; });
+        if (no_disks && sector_cache.get_capacity() != plugin_config.diskio_cache_sectors) {
+            sector_cache.set_capacity(plugin_config.diskio_cache_sectors);
+        }
+        descr.state.store(disk_descriptor_t::disk_busy, std::memory_order_relaxed);
 
-        if (!fp) {
+        auto image = acquire_image_file(image_path, true);
+        if (!image) {
             plugin_config.log_print_dbg("Warning# in disk_initialize, failed to opend image %s",
                 image_path);
+            descr.state.store(disk_descriptor_t::disk_free, std::memory_order_relaxed);
             return STA_NOINIT;
         }
 
+        descr.image = std::move(image);
+        descr.boot_sector_offset = boot_sector_offset;
+        ++descr.generation;
+        sector_cache.reset_stats(pdrv);
+        descr.state.store(disk_descriptor_t::disk_ready, std::memory_order_release);
+
         return RES_OK;
     }
 
@@ -79,15 +169,9 @@ extern "C" {
     {
         plugin_config.log_print_dbg("Info# disk_status called for the disk %d.", pdrv);
 
-        if (disk_descriptors.count(pdrv) == 0) {
-            plugin_config.log_print_dbg("Warning# in disk_status, disk %d -- no such driver.", pdrv);
-            return RES_PARERR;
-        }
-
-        if (!disk_descriptors[pdrv].file) {
-            plugin_config.log_print_dbg("Warning# in disk_status, disk %d -- image \'%s\' is not opened.",
-                pdrv, disk_descriptors[pdrv].PathName.data());
-            return RES_NOTRDY;
+        if (!get_ready_disk(pdrv)) {
+            plugin_config.log_print_dbg("Warning# in disk_status, disk %d -- not opened.", pdrv);
+            return STA_NOINIT;
         }
 
         return RES_OK;
@@ -105,30 +189,12 @@ extern "C" {
         UINT count		/* Number of sectors to read */
     )
     {
-        if (disk_descriptors.count(pdrv) == 0) {
-            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- no such driver.", pdrv);
-            return RES_PARERR;
-        }
-
-        FILE* fp = disk_descriptors[pdrv].file;
-        if (!fp) {
-            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- image \'%s\' is not opened.",
-                pdrv, disk_descriptors[pdrv].PathName.data());
+        if (!get_ready_disk(pdrv)) {
+            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- not opened.", pdrv);
             return RES_NOTRDY;
         }
-		// TODO: replace with functions that support files larger than 2GB
-        if ( fseek(fp, sector * FF_MIN_SS + disk_descriptors[pdrv].boot_sector_offset, SEEK_SET) != 0) {
-            int cur_err = errno;
-            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- image \'%s\' seek error, errno = %d, \'%s\'.",
-                pdrv, disk_descriptors[pdrv].PathName.data(), cur_err, strerror(cur_err) );
-            return RES_ERROR;
-        }
-        auto read_s = fread(buff, FF_MIN_SS, count, fp); 
-        if (read_s != count) {
-            int cur_err = errno;
-            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- image \'%s\' read error, errno = %d, \'%s\'."
-                " Requested %d sectors, read %d",
-                pdrv, disk_descriptors[pdrv].PathName.data(), cur_err, strerror(cur_err), read_s, count);
+
+        if (!sector_cache.read(pdrv, buff, sector, count)) {
             return RES_ERROR;
         }
 
@@ -150,37 +216,16 @@ extern "C" {
         UINT count			/* Number of sectors to write */
     )
     {
-        DRESULT res;
-        if (disk_descriptors.count(pdrv) == 0) {
-            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- no such driver.", pdrv);
-            return RES_PARERR;
-        }
-
-        FILE* fp = disk_descriptors[pdrv].file;
-        if (!fp) {
-            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- image \'%s\' is not opened.",
-                pdrv, disk_descriptors[pdrv].PathName.data());
+        if (!get_ready_disk(pdrv)) {
+            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- not opened.", pdrv);
             return RES_NOTRDY;
         }
 
-        if (fseek(fp, sector * FF_MIN_SS + disk_descriptors[pdrv].boot_sector_offset, SEEK_SET) != 0) {
-            int cur_err = errno;
-            plugin_config.log_print_dbg("Warning# in disk_write, disk %d -- image \'%s\' seek error, errno = %d, \'%s\'.",
-                pdrv, disk_descriptors[pdrv].PathName.data(), cur_err, strerror(cur_err));
+        if (!sector_cache.write(pdrv, buff, sector, count)) {
             return RES_ERROR;
         }
 
-        auto written_s = fwrite(buff, FF_MIN_SS, count, fp);
-        if (written_s != count) {
-            int cur_err = errno;
-            plugin_config.log_print_dbg("Warning# in disk_read, disk %d -- image \'%s\' read error, errno = %d, \'%s\'."
-                " Requested %d sectors, read %d",
-                pdrv, disk_descriptors[pdrv].PathName.data(), cur_err, strerror(cur_err), written_s, count);
-            return RES_ERROR;
-        }
-
-        res = RES_OK;
-        return res;
+        return RES_OK;
     }
 
 #endif
@@ -196,37 +241,60 @@ extern "C" {
         void* buff		/* Buffer to send/receive control data */
     )
     {
+        auto descr = get_ready_disk(pdrv);
+        if (!descr) {
+            plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- not opened.", pdrv);
+            return RES_NOTRDY;
+        }
+
 		DRESULT res = RES_ERROR;
         switch (cmd) {
         case CTRL_SYNC:
-            res = RES_OK; // Implement flush on CTRL_SYNC? 
+            if (!sector_cache.flush(pdrv)) {
+                plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- image \'%s\' cache flush failed.",
+                    pdrv, descr->image->path.data());
+                return RES_ERROR;
+            }
+            res = RES_OK;
             break;
 
         case GET_SECTOR_COUNT: {
-            if (disk_descriptors.count(pdrv) == 0) {
-                plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- no such driver.", pdrv);
-                return RES_PARERR;
-            }
-            FILE* fp = disk_descriptors[pdrv].file;
-            if (!fp) {
-                plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- image \'%s\' is not opened.",
-                    pdrv, disk_descriptors[pdrv].PathName.data());
-                return RES_NOTRDY;
-            }
-            auto size = get_file_size(disk_descriptors[pdrv].PathName.data()); // TODO: fix to use same file handlers here and in sysio_xx.cpp
-            if(size == -1){
-                plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- image \'%s\' get_file_size() failed.",
-                    pdrv, disk_descriptors[pdrv].PathName.data());
-                return RES_ERROR;
-			}
-            *(DWORD*)buff = static_cast<DWORD>(size / FF_MIN_SS); // Number of sectors
-            res = RES_OK;
+            // LBA_t is 32-bit (FF_LBA64 requires exFAT) -- clamp instead of wrapping around for >2Tb images
+            uint64_t sectors = descr->image->size / FF_MIN_SS;
+            *(LBA_t*)buff = static_cast<LBA_t>(std::min<uint64_t>(sectors, static_cast<LBA_t>(-1))); // Number of sectors
         }
+            res = RES_OK;
 			break;
         case GET_BLOCK_SIZE:
             *(DWORD*)buff = 1; // One sector 
 			res = RES_OK; 
             break;
+        case CTRL_TRIM:
+        case CTRL_TRIM_VOLUME: {
+            // Freed clusters, or the whole volume by f_mkfs(). Range is inclusive.
+            const LBA_t* range = static_cast<const LBA_t*>(buff);
+            if (range[1] < range[0])
+                return RES_PARERR;
+            uint64_t count = static_cast<uint64_t>(range[1]) - range[0] + 1;
+            // Cached copies are dropped in any case: FatFS does not expect the freed data to survive
+            sector_cache.discard(pdrv, range[0], count);
+            // Non-sparse new images keep their 0xFF filling
+            const bool punch = (cmd == CTRL_TRIM_VOLUME) ? plugin_config.sparse_new_images : plugin_config.trim_freed_clusters;
+            if (!punch)
+                return RES_OK;
+            uint64_t offset = static_cast<uint64_t>(range[0]) * FF_MIN_SS + descr->boot_sector_offset;
+            if (offset >= descr->image->size)
+                return RES_OK;
+            uint64_t size = std::min<uint64_t>(count * FF_MIN_SS, descr->image->size - offset);
+            if (!punch_hole(descr->image->handle, offset, size)) {
+                plugin_config.log_print_dbg("Warning# in disk_ioctl, disk %d -- image \'%s\' CTRL_TRIM of %llu sectors at LBA %llu failed.",
+                    pdrv, descr->image->path.data(), static_cast<unsigned long long>(count),
+                    static_cast<unsigned long long>(range[0]));
+                return RES_ERROR; // FatFS ignores it, freed data just stays in the image
+            }
+        }
+            res = RES_OK;
+            break;
         }
 
         return res;
@@ -235,13 +303,29 @@ extern "C" {
 
     DRESULT disk_deinitialize(const char* name_in) {
         plugin_config.log_print_dbg("Info# disk_deinitialize: \'%s\'.", name_in);
-        for (auto& [id, descr] : disk_descriptors) {
-            if ( strcmp(descr.PathName.data(), name_in) == 0 ) {
-                if(descr.file)
-                    fclose(descr.file);
-                disk_descriptors.erase(id);
-                return RES_OK;
+        std::lock_guard<std::mutex> lock(disk_descriptors_mux);
+        for (BYTE id = 0; id < disk_descriptors.size(); ++id) {
+            auto& descr = disk_descriptors[id];
+            if (descr.state.load(std::memory_order_relaxed) != disk_descriptor_t::disk_ready)
+                continue;
+            if (strcmp(descr.image->path.data(), name_in) != 0)
+                continue;
+
+            descr.state.store(disk_descriptor_t::disk_busy, std::memory_order_relaxed);
+            DRESULT res = RES_OK;
+            if (!sector_cache.drop_drive(id)) {
+                plugin_config.log_print_dbg("Warning# disk_deinitialize: cache flush failed for \'%s\'.", name_in);
+                res = RES_ERROR;
             }
+            auto st = sector_cache.get_stats(id);
+            plugin_config.log_print_dbg("Info# disk_deinitialize: disk %d (generation %u), sector cache for \'%s\' -- "
+                "hits: %zu, misses: %zu, written back: %zu in %zu host writes (%zu saved), evicted: %zu.",
+                id, descr.generation, name_in, st.hits, st.misses, st.writebacks, st.host_writes,
+                st.writebacks - st.host_writes, st.evictions);
+            descr.image.reset();
+            descr.boot_sector_offset = 0;
+            descr.state.store(disk_descriptor_t::disk_free, std::memory_order_release);
+            return res;
         }
         plugin_config.log_print_dbg("Warning# disk_deinitialize failed for: \'%s\'.", name_in);
         return RES_ERROR;
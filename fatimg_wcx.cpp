@@ -15,6 +15,12 @@
 */
 
 #include "sysio_winapi.h"
+#include "image_file.h"
+#include "paged_FAT.h"
+#include "FAT_decode.h"
+#include "work_stealing_pool.h"
+#include "copy_pipeline.h"
+#include "listing_cache.h"
 #include "minimal_fixed_string.h"
 #include "FAT_definitions.h"
 #include "plugin_config.h"
@@ -26,7 +32,12 @@
 #include <vector>
 #include <algorithm>
 #include <optional>
+#include <span>
 #include <map>
+#include <unordered_map>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
 //#include <atomic>
 #include <cassert>
 #include <sys/stat.h>
@@ -78,10 +89,11 @@ using std::nothrow, std::uint8_t;
 //! This can help but reverting to the def-file is simpler:
 //! #pragma comment(linker, "/EXPORT:" __FUNCTION__ "=" __FUNCDNAME__) 
 #else
-#define WCX_API
+#define DLLEXPORT
 #define STDCALL
 #endif 
 
+#ifdef _WIN32
 // The DLL entry point
 BOOL APIENTRY DllMain(HANDLE hModule,
 	DWORD  ul_reason_for_call,
@@ -102,6 +114,7 @@ BOOL APIENTRY DllMain(HANDLE hModule,
 #endif 
 	return TRUE;
 }
+#endif 
 
 bool set_file_attributes_ex(const char* filename, FAT_attrib_t attribute) {
 	/*
@@ -114,13 +127,40 @@ bool set_file_attributes_ex(const char* filename, FAT_attrib_t attribute) {
 	return set_file_attributes(filename, attribute.get_user_attr()); // Codes are equal
 }
 
+//! Listing entry. Its name is kept in the FAT_image_t::names_arena, the full path is assembled
+//! from the names of the parent directories when needed -- see FAT_image_t::get_entry_path().
 struct arc_dir_entry_t
 {
-	minimal_fixed_string_t<MAX_PATH> PathName;
-	size_t FileSize = 0;
+	static constexpr uint32_t no_parent = static_cast<uint32_t>(-1);
+
+	uint32_t name_offset = 0;     // C-string in the names arena; directory names end with '\\'
+	uint32_t parent = no_parent;  // Index of the parent directory entry
+	uint32_t FileSize = 0;
 	uint32_t FileTime = 0;
-	FAT_attrib_t FileAttr{};
 	uint32_t FirstClus = 0;
+	FAT_attrib_t FileAttr{};
+};
+
+//! Entries of a single directory with the listings of its subdirectories. Filled by one task, so the
+//! parallel traversal needs no locking; merged into the FAT_image_t::arc_dir_entries in the DFS order.
+struct dir_listing_t {
+	std::vector<arc_dir_entry_t> entries; // name_offset -- into the names below, parent is not used
+	std::vector<char> names;
+	std::vector<std::pair<uint32_t, std::unique_ptr<dir_listing_t>>> subdirs; // Entry index -> its listing
+	bool has_OS2_EA = false;
+	// Lazy listing: the directory is not read yet, it will be read when the ReadHeader() reaches it
+	bool is_pending = false;
+	uint32_t first_cluster = 0;
+	uint32_t depth = 0;
+};
+
+//! Lazy listing: the directory, read in background one level ahead of the ReadHeader()
+struct dir_prefetch_t {
+	enum states_t { queued, running, done };
+	std::mutex mux;
+	std::condition_variable cv;
+	states_t state = queued; // If ReadHeader() reaches the queued directory, it reads the directory itself
+	dir_listing_t listing;
 };
 
 plugin_config_t plugin_config;
@@ -130,12 +170,31 @@ std::mutex plugin_config_inuse; // When it is a member of the plugin_config_t, i
 //! Contains archive configuration, so FAT_image_t needs it
 struct whole_disk_t;
 
+//! Limits of the FAT12/16/32 cluster numbers, for the code specialized by the FAT width.
+//! See FAT_image_t::max_cluster_FAT() and others for their meaning.
+template<unsigned FAT_bits> struct FAT_traits_t;
+template<> struct FAT_traits_t<12> {
+	static constexpr uint32_t max_cluster = 0xFF6;
+	static constexpr uint32_t max_normal_cluster = 0xFF0 - 1;
+	static constexpr uint32_t min_end_of_chain = 0xFF8;
+};
+template<> struct FAT_traits_t<16> {
+	static constexpr uint32_t max_cluster = 0xFF'F6;
+	static constexpr uint32_t max_normal_cluster = 0xFF'F0 - 1;
+	static constexpr uint32_t min_end_of_chain = 0xFF'F8;
+};
+template<> struct FAT_traits_t<32> {
+	static constexpr uint32_t max_cluster = 0xF'FF'FF'F6;
+	static constexpr uint32_t max_normal_cluster = 0xF'FF'FF'F0 - 1;
+	static constexpr uint32_t min_end_of_chain = 0xF'FF'FF'F8;
+};
+
 struct FAT_image_t
 {
 	enum FAT_types { unknown_FS_type, FAT12_type, FAT16_type, FAT32_type, exFAT_type}; // , FAT_DOS100_type, FAT_DOS110_type
 
 	const whole_disk_t* whole_disk_ptr = nullptr;
-	size_t boot_sector_offset = 0;
+	uint64_t boot_sector_offset = 0; // Image offsets are 64-bit even for the 32-bit builds -- multi-GB disk dumps
 
 	bool is_processed_m = false;	// Useful when unknown FS or empty FAT FS
 
@@ -143,12 +202,24 @@ struct FAT_image_t
 	bool has_OS2_EA = false;
 
 	std::vector<uint8_t> fattable;
+	const uint8_t* fat_view_m = nullptr; // FAT inside the mapped image; fattable is not used then
+	std::shared_ptr<paged_FAT_t> paged_fat_m; // Large FAT16/32 loaded on demand; fattable is not used then
+	std::vector<uint32_t> next_cluster_m; // FAT12, unpacked by decode_FAT(); empty -- not decoded
 	std::vector<arc_dir_entry_t> arc_dir_entries;
+	std::vector<char> names_arena; // Names of the arc_dir_entries, '\0'-separated
+	//! Lazy listing: subdirectories are not read on open, see expand_pending_dir()
+	bool lazy_listing_m = false;
+	struct pending_dir_t {
+		uint32_t first_cluster = 0;
+		uint32_t depth = 0;
+		std::shared_ptr<dir_prefetch_t> prefetch; // nullptr if not prefetched
+	};
+	std::unordered_map<uint32_t, pending_dir_t> pending_dirs_m; // Entry index -> its not yet read directory
 	FAT_boot_sector_t bootsec{};
 
-	size_t FAT1area_off_m = 0; //number of uint8_t before first FAT area 
-	size_t rootarea_off_m = 0; //number of uint8_t before root area 
-	size_t dataarea_off_m = 0; //number of uint8_t before data area
+	uint64_t FAT1area_off_m = 0; //number of uint8_t before first FAT area 
+	uint64_t rootarea_off_m = 0; //number of uint8_t before root area 
+	uint64_t dataarea_off_m = 0; //number of uint8_t before data area
 	uint32_t cluster_size_m = 0;
 	uint32_t counter = 0;
 
@@ -161,16 +232,16 @@ struct FAT_image_t
 
 	~FAT_image_t() = default;
 
-	void set_boot_sector_offset(size_t off) {
+	void set_boot_sector_offset(uint64_t off) {
 		boot_sector_offset = off;
 	}
 
-	size_t get_boot_sector_offset() const {
+	uint64_t get_boot_sector_offset() const {
 		return boot_sector_offset;
 	}
 
-	size_t cluster_to_image_off(uint32_t cluster) {
-		return get_data_area_offset() + static_cast<size_t>(cluster - 2) * get_cluster_size(); //-V104
+	uint64_t cluster_to_image_off(uint32_t cluster) {
+		return get_data_area_offset() + static_cast<uint64_t>(cluster - 2) * get_cluster_size(); //-V104
 	}
 
 	uint32_t get_sectors_per_FAT() const {
@@ -190,17 +261,17 @@ struct FAT_image_t
 	}
 
 	size_t get_root_dir_size() const {
-		return get_data_area_offset() - get_root_area_offset(); //-V110
+		return static_cast<size_t>(get_data_area_offset() - get_root_area_offset()); //-V110
 	}
 
-	size_t get_FAT1_area_offset() const {
+	uint64_t get_FAT1_area_offset() const {
 		return FAT1area_off_m;
 	}
-	size_t get_root_area_offset() const {
+	uint64_t get_root_area_offset() const {
 		return rootarea_off_m;
 	}
 
-	size_t get_data_area_offset() const {
+	uint64_t get_data_area_offset() const {
 		return dataarea_off_m;
 	}
 
@@ -210,12 +281,38 @@ struct FAT_image_t
 
 	size_t get_sector_size() const;
 	auto   get_openmode() const;
-	size_t get_image_file_size() const;
+	uint64_t get_image_file_size() const;
 	file_handle_t get_archive_handler() const;
+	//! Pointer to the image range if it is mapped, nullptr otherwise -- then read_file_at() should be used
+	const uint8_t* get_image_view(uint64_t offset, size_t size) const;
+
+	//! Whole FAT in memory (mapped or loaded). Empty for the paged FAT -- use read_FAT_entry() then.
+	std::span<const uint8_t> get_FAT_bytes() const {
+		if (fat_view_m)
+			return { fat_view_m, get_bytes_per_FAT() };
+		return { fattable.data(), fattable.size() };
+	}
+
+	//! FAT16/32 entry access for any FAT representation. Returns false for the out-of-FAT or unreadable entries.
+	template<typename T>
+	bool read_FAT_entry(uint32_t cluster, T& value) const {
+		size_t pos = static_cast<size_t>(cluster) * sizeof(T);
+		if (paged_fat_m) {
+			return paged_fat_m->read(pos, &value, sizeof(T));
+		}
+		const auto fat = get_FAT_bytes();
+		if (pos >= fat.size() || sizeof(T) > fat.size() - pos)
+			return false;
+		std::memcpy(&value, fat.data() + pos, sizeof(T));
+		return true;
+	}
 
 	uint64_t get_total_sectors_in_volume() const;
 	uint64_t get_data_sectors_in_volume() const;
 	uint64_t get_data_clusters_in_volume() const;
+	//! get_data_clusters_in_volume(), computed once by process_bootsector() -- it logs and could show dialogs,
+	//! so it should not be called from the listing threads
+	uint64_t data_clusters_m = 0;
 
 	bool is_processed() const {
 		if (arc_dir_entries.empty())
@@ -234,6 +331,8 @@ struct FAT_image_t
 	int search_for_bootsector();
 
 	int load_FAT();
+	//! Unpacks the FAT12 into the next_cluster_m. Optional -- left empty if there is no memory.
+	void decode_FAT();
 
 	FAT_types detect_FAT_type() const;
 
@@ -241,17 +340,135 @@ struct FAT_image_t
 		return FAT_type == FAT12_type || FAT_type == FAT16_type || FAT_type == FAT32_type;
 	}
 
-	int extract_to_file(file_handle_t hUnpFile, uint32_t idx);
-
-	// root passed by copy to avoid problems while relocating vector
-	int load_file_list_recursively(minimal_fixed_string_t<MAX_PATH> root, uint32_t firstclus, uint32_t depth); //-V813
+	//! Identifies the volume for the listing cache: its position, boot sector and the FAT, if it is in memory.
+	//! Paged FAT is not read whole for this -- such volumes rely on the image size and modification time.
+	uint64_t get_fs_hash() const;
+
+	//! dest is passed to the progress callback
+	int extract_to_file(file_handle_t hUnpFile, uint32_t idx, char* dest);
+
+	//! Reads the root directory into the listing. With pool != nullptr the subdirectories are submitted 
+	//! to it -- wait for the pool before finish_file_list(). Errors of the root directory are returned.
+	int start_file_list(dir_listing_t& root_listing, work_stealing_pool_t* pool);
+	//! Moves the read tree to the arc_dir_entries, returns start_res or E_NO_MEMORY
+	int finish_file_list(dir_listing_t& root_listing, int start_res);
+	//! With pool != nullptr the subdirectories are submitted to it as separate tasks, otherwise read recursively
+	int load_file_list_recursively(dir_listing_t& listing, uint32_t firstclus, uint32_t depth, work_stealing_pool_t* pool);
+	//! load_file_list_recursively() for the given FAT width and representation, dispatched once per listing --
+	//! see with_FAT_reader(). Subdirectories are read with the same reader.
+	template<typename reader_t>
+	int load_directory(const reader_t& next_of, dir_listing_t& listing, uint32_t firstclus, uint32_t depth,
+		work_stealing_pool_t* pool);
+	void merge_listing(dir_listing_t& listing, uint32_t parent_idx);
+	//! Lazy listing: reads the directory of the entry, if it is not read yet, appending its entries to the
+	//! arc_dir_entries. They are listed after all the already known ones, so the order differs from the DFS.
+	void expand_pending_dir(uint32_t idx);
+	void add_pending_dir(uint32_t idx, const dir_listing_t& listing);
+
+	const char* get_entry_name(uint32_t idx) const {
+		return names_arena.data() + arc_dir_entries[idx].name_offset;
+	}
+	void append_entry_path(uint32_t idx, minimal_fixed_string_t<MAX_PATH>& path) const {
+		const auto& entry = arc_dir_entries[idx];
+		if (entry.parent != arc_dir_entry_t::no_parent)
+			append_entry_path(entry.parent, path); // Depth is limited by the max_depth
+		path.push_back(get_entry_name(idx));
+	}
+	minimal_fixed_string_t<MAX_PATH> get_entry_path(uint32_t idx) const {
+		minimal_fixed_string_t<MAX_PATH> path;
+		append_entry_path(idx, path);
+		return path;
+	}
 
 	uint32_t get_first_cluster(const FATxx_dir_entry_t& dir_entry) const;
+	template<unsigned FAT_bits>
+	static uint32_t get_first_cluster(const FATxx_dir_entry_t& dir_entry) {
+		if constexpr (FAT_bits == 12)
+			return dir_entry.get_first_cluster_FAT12();
+		else if constexpr (FAT_bits == 16)
+			return dir_entry.get_first_cluster_FAT16();
+		else
+			return dir_entry.get_first_cluster_FAT32();
+	}
 
 	uint32_t next_cluster_FAT12(uint32_t firstclus) const;
 	uint32_t next_cluster_FAT16(uint32_t firstclus) const;
 	uint32_t next_cluster_FAT32(uint32_t firstclus) const;
 	uint32_t next_cluster_FAT(uint32_t firstclus) const;
+	template<unsigned FAT_bits>
+	uint32_t next_cluster(uint32_t firstclus) const {
+		if constexpr (FAT_bits == 12) {
+			if (firstclus < next_cluster_m.size())
+				return next_cluster_m[firstclus]; // Pre-decoded, see decode_FAT()
+			return next_cluster_FAT12(firstclus);
+		}
+		else if constexpr (FAT_bits == 16)
+			return next_cluster_FAT16(firstclus);
+		else
+			return next_cluster_FAT32(firstclus);
+	}
+
+	//! Next-cluster lookup for the walks over the FAT in memory -- mapped, loaded or, for FAT12, decoded.
+	//! Single indexed load; out-of-FAT clusters go to next_cluster(), which reports them.
+	template<unsigned FAT_bits>
+	struct FAT_span_reader_t {
+		static constexpr unsigned FAT_width = FAT_bits;
+		const FAT_image_t* image;
+		const uint8_t* fat;       // FAT16/32
+		const uint32_t* decoded;  // FAT12, see decode_FAT(); if not decoded, entries is 0 and all goes to next_cluster()
+		size_t entries;
+		uint32_t operator()(uint32_t cluster) const {
+			if (cluster >= entries) [[unlikely]]
+				return image->next_cluster<FAT_bits>(cluster);
+			if constexpr (FAT_bits == 12) {
+				return decoded[cluster];
+			}
+			else if constexpr (FAT_bits == 16) {
+				uint16_t next;
+				std::memcpy(&next, fat + static_cast<size_t>(cluster) * sizeof(next), sizeof(next));
+				return next;
+			}
+			else {
+				uint32_t next;
+				std::memcpy(&next, fat + static_cast<size_t>(cluster) * sizeof(next), sizeof(next));
+				return next & 0x0F'FF'FF'FF; // Zero upper 4 bits
+			}
+		}
+	};
+	//! Next-cluster lookup for the paged FAT16/32
+	template<unsigned FAT_bits>
+	struct FAT_paged_reader_t {
+		static constexpr unsigned FAT_width = FAT_bits;
+		const FAT_image_t* image;
+		paged_FAT_t* paged_fat;
+		uint32_t operator()(uint32_t cluster) const {
+			if constexpr (FAT_bits == 16) {
+				uint16_t next;
+				if (paged_fat->read(static_cast<size_t>(cluster) * sizeof(next), &next, sizeof(next)))
+					return next;
+			}
+			else {
+				uint32_t next;
+				if (paged_fat->read(static_cast<size_t>(cluster) * sizeof(next), &next, sizeof(next)))
+					return next & 0x0F'FF'FF'FF;
+			}
+			return image->next_cluster<FAT_bits>(cluster); // Reports the error
+		}
+	};
+	//! Calls f(reader) with the reader for the current FAT representation, so it is chosen once per chain walk
+	//! or listing instead of on each step
+	template<unsigned FAT_bits, typename F>
+	auto with_FAT_reader(const F& f) const {
+		if constexpr (FAT_bits != 12) {
+			if (paged_fat_m)
+				return f(FAT_paged_reader_t<FAT_bits>{ this, paged_fat_m.get() });
+		}
+		const auto fat = get_FAT_bytes();
+		if constexpr (FAT_bits == 12)
+			return f(FAT_span_reader_t<FAT_bits>{ this, nullptr, next_cluster_m.data(), next_cluster_m.size() });
+		else
+			return f(FAT_span_reader_t<FAT_bits>{ this, fat.data(), nullptr, fat.size() / (FAT_bits / 8) });
+	}
 
 	uint32_t max_cluster_FAT(FAT_types type) const; // For FAT detect
 	uint32_t max_cluster_FAT() const;
@@ -260,53 +477,134 @@ struct FAT_image_t
 	uint32_t min_end_of_chain_FAT() const;
 	bool is_end_of_chain_FAT(uint32_t) const;
 
+	//! Consecutive clusters of a chain -- could be read by a single I/O
+	struct cluster_run_t {
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+	//! Converts the cluster chain into runs, using the FAT in memory. first_cluster should be checked by the caller.
+	//! Walk stops after max_clusters clusters, at the end of chain mark, or at the cluster rejected by the is_valid(),
+	//! which is saved to the stop_cluster. Returns the number of clusters in the runs.
+	//! FAT width and representation are dispatched once per chain, the walk itself is specialized -- see get_chain_runs_FAT().
+	template<typename F>
+	size_t get_chain_runs(uint32_t first_cluster, size_t max_clusters, std::vector<cluster_run_t>& runs,
+		const F& is_valid, uint32_t& stop_cluster) const {
+		auto walk = [&](const auto& next_of) {
+			return get_chain_runs_FAT(next_of, first_cluster, max_clusters, runs, is_valid, stop_cluster);
+		};
+		switch (FAT_type) {
+		case FAT12_type:
+			return with_FAT_reader<12>(walk);
+		case FAT16_type:
+			return with_FAT_reader<16>(walk);
+		case FAT32_type:
+			return with_FAT_reader<32>(walk);
+		default:
+			runs.clear();
+			stop_cluster = 0;
+			return 0;
+		}
+	}
+	template<typename reader_t, typename F>
+	static size_t get_chain_runs_FAT(const reader_t& next_of, uint32_t first_cluster, size_t max_clusters,
+		std::vector<cluster_run_t>& runs, const F& is_valid, uint32_t& stop_cluster) {
+		constexpr unsigned FAT_bits = reader_t::FAT_width;
+		runs.clear();
+		uint32_t cluster = first_cluster;
+		size_t clusters = 0;
+		while (clusters < max_clusters) {
+			if (!runs.empty() && runs.back().first + runs.back().count == cluster)
+				++runs.back().count;
+			else
+				runs.push_back({ cluster, 1 });
+			++clusters;
+			cluster = next_of(cluster);
+			if (cluster >= FAT_traits_t<FAT_bits>::min_end_of_chain || !is_valid(cluster))
+				break;
+		}
+		stop_cluster = cluster;
+		return clusters;
+	}
+	//! Directory clusters are read by the runs, but not more than this at once
+	static constexpr size_t max_dir_read_size = 256 * 1024;
+
+	//! UCS-2 parts of the LFN are collected by their ordinals and converted to the local codepage at once,
+	//! when the short entry is reached -- see get_LFN_name().
 	struct LFN_accumulator_t {
-		minimal_fixed_string_t<MAX_PATH> cur_LFN_name{};
+		static constexpr uint32_t max_parts = VFAT_LFN_dir_entry_t::max_LFN_ordinal;
+		static constexpr size_t part_size = VFAT_LFN_dir_entry_t::LFN_name_part_size;
+		wchar_t parts[max_parts][part_size];
+		uint8_t part_lengths[max_parts];
+		uint32_t parts_number = 0; // Ordinal of the first record
 		uint8_t cur_LFN_CRC = 0;
 		int cur_LFN_record_index = 0;
 		void start_processing(const VFAT_LFN_dir_entry_t* LFN_record) {
 			cur_LFN_CRC = LFN_record->LFN_DOS_name_CRC;
 			cur_LFN_record_index = 1;
-			cur_LFN_name.clear();
-			LFN_record->dir_LFN_entry_to_ASCII_str(cur_LFN_name);
+			parts_number = LFN_record->get_LFN_ordinal();
+			std::fill_n(part_lengths, parts_number, uint8_t{ 0 }); // Missing parts are empty
+			store_LFN_part(LFN_record);
 		}
 		void append_LFN_part(const VFAT_LFN_dir_entry_t* LFN_record) {
 			++cur_LFN_record_index;
-			minimal_fixed_string_t<MAX_PATH> next_LFN_part;
-			LFN_record->dir_LFN_entry_to_ASCII_str(next_LFN_part);
-			next_LFN_part.push_back(cur_LFN_name);
-			cur_LFN_name = next_LFN_part;
+			store_LFN_part(LFN_record);
+		}
+		void store_LFN_part(const VFAT_LFN_dir_entry_t* LFN_record) {
+			const uint32_t slot = LFN_record->get_LFN_ordinal() - 1; // Checked by process_LFN_record()
+			bool wrong_symbol = false;
+			part_lengths[slot] = static_cast<uint8_t>(LFN_record->get_LFN_part(parts[slot], wrong_symbol));
 		}
 		void abort_processing() {
 			cur_LFN_CRC = 0;
 			cur_LFN_record_index = 0;
-			cur_LFN_name.clear();
+			parts_number = 0;
 		}
 		bool are_processing() {
 			return cur_LFN_record_index > 0;
 		}
 		void process_LFN_record(const FATxx_dir_entry_t* entry);
+		//! Appends the collected name to the name. Returns false if it is empty or could not be converted.
+		template<typename T>
+		bool get_LFN_name(T& name) const {
+			wchar_t ucs16_name[max_parts * part_size];
+			size_t length = 0;
+			for (uint32_t slot = 0; slot < parts_number; ++slot) {
+				std::copy_n(parts[slot], part_lengths[slot], ucs16_name + length);
+				length += part_lengths[slot];
+			}
+			if (length == 0)
+				return false;
+			// Up to two bytes per symbol for DBCS, but not longer than the path -- such names are not converted
+			char local_name[MAX_PATH] = { 0 };
+			const size_t local_size = std::min(2 * length, sizeof(local_name) - 1);
+			if (ucs16_to_local(local_name, local_size, ucs16_name, length) != 0)
+				return false;
+			name.push_back(local_name);
+			return true;
+		}
 	};
 };
 
 struct partition_info_t {
-	uint32_t first_sector = 0;
-	uint32_t last_sector = 0;
+	uint64_t first_sector = 0; // MBR LBAs are 32-bit, but their byte offsets are not
+	uint64_t last_sector = 0;
 	uint8_t  partition_id = 0;
 };
 
 struct whole_disk_t {	
 	static constexpr uint32_t sector_size = 512;
 	minimal_fixed_string_t<MAX_PATH> archname; // Should be saved for the TCmd API
-	file_handle_t hArchFile = file_handle_t(); //opened file handles
+	image_file_ptr_t image;                    // Shared with FatFS when the image is modified
+	file_handle_t hArchFile = file_handle_t(); // Owned by the image
 	int openmode_m = PK_OM_LIST;
-	size_t image_file_size = 0;
+	uint64_t image_file_size = 0;
+	const uint8_t* image_view = nullptr; // Whole image, if mapped -- see plugin_config.use_memory_mapping
 
 	static tChangeVolProc   pLocChangeVol;
 	static tProcessDataProc pLocProcessData;
 
-	whole_disk_t(const char* archname_in, size_t vol_size, file_handle_t fh, int openmode):
-		hArchFile{ fh }, openmode_m(openmode), image_file_size(vol_size)
+	whole_disk_t(const char* archname_in, image_file_ptr_t image_in, int openmode):
+		image{ std::move(image_in) }, hArchFile{ image->handle }, openmode_m(openmode), image_file_size(image->size)
 	{
 		archname.push_back(archname_in);
 		// First disk represents also non-partitioned image -- so, initially, it's size = whole image size.
@@ -340,22 +638,156 @@ struct whole_disk_t {
 		return res;
 	}
 
-	~whole_disk_t() {
-		if (hArchFile)
-			close_file(hArchFile);
+	//! Process boot record if it is a single-disk volume or process all known volumes from the MBR.
+	//! Partitions boot sectors are processed in the pool, if it is given and no dialogs could be shown.
+	int process_volumes(work_stealing_pool_t* pool = nullptr);
+	//! process_volumes(), reusing the recent result for the same unchanged image -- TCmd calls
+	//! CanYouHandleThisFile() and then immediately OpenArchive(), both probing the image.
+	int probe_volumes(work_stealing_pool_t* pool = nullptr);
+	//! Should be called before the image is modified
+	static void forget_probe(const char* archname);
+
+	//! Listing cache, see listing_cache.h. listed[i] -- the directory tree of disks[i] should be read,
+	//! fs_hashes[i] -- disks[i].get_fs_hash(). Returns false if the tree should be read from the image.
+	bool list_from_cache(const std::vector<char>& listed, const std::vector<uint64_t>& fs_hashes);
+	void save_to_cache(const std::vector<char>& listed, const std::vector<uint64_t>& fs_hashes) const;
+	static constexpr uint32_t cached_listed = 1;
+	static constexpr uint32_t cached_OS2_EA = 2;
+
+	//! Boot sector processing could ask user, changing the plugin_config -- should not be done in parallel
+	bool may_show_dialogs() const {
+#ifdef FLTK_ENABLED_EXPERIMENTAL
+		return plugin_config.allow_dialogs && openmode_m == PK_OM_LIST;
+#else
+		return false;
+#endif 
 	}
 
-	//! Process boot record if it is a single-disk volume or process all known volumes from the MBR 
-	int process_volumes();
-
 	//! Error handler for safe functions:
 	_invalid_parameter_handler oldHandler = nullptr;
+
+	//! Lazy listing: reads the directories one level ahead of the ReadHeader(). Declared last, so it is
+	//! destroyed first -- its tasks use the disks. Queued tasks are dropped, the running ones are finished.
+	struct prefetcher_t {
+		std::atomic<bool> stop{ false };
+		std::unique_ptr<work_stealing_pool_t> pool; // nullptr -- no prefetching
+		~prefetcher_t() {
+			stop = true;
+			pool.reset();
+		}
+	} prefetcher;
 };
 
 tChangeVolProc   whole_disk_t::pLocChangeVol = nullptr;
 tProcessDataProc whole_disk_t::pLocProcessData = nullptr;
 
 
+bool whole_disk_t::list_from_cache(const std::vector<char>& listed, const std::vector<uint64_t>& fs_hashes) {
+	const cached_image_id_t image_id{ archname.data(), image_file_size, get_file_mtime(hArchFile) };
+	std::vector<cached_volume_t> volumes;
+	if (!load_listing_cache(plugin_config.listing_cache_dir.data(), image_id, sizeof(arc_dir_entry_t), volumes) ||
+		volumes.size() != disks.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < disks.size(); ++i) {
+		if (volumes[i].fs_hash != fs_hashes[i] || ((volumes[i].flags & cached_listed) != 0) != (listed[i] != 0))
+			return false;
+		// Cache file is checked by the hash, but it is outside of our control -- indexes should be checked anyway
+		const auto& names = volumes[i].names;
+		if (volumes[i].entries_n != 0 && (names.empty() || names.back() != '\0'))
+			return false;
+		for (uint32_t j = 0; j < volumes[i].entries_n; ++j) {
+			arc_dir_entry_t entry;
+			std::memcpy(&entry, volumes[i].entries.data() + j * sizeof(arc_dir_entry_t), sizeof(entry));
+			if (entry.name_offset >= names.size() || (entry.parent != arc_dir_entry_t::no_parent && entry.parent >= j))
+				return false;
+		}
+	}
+	try {
+		for (size_t i = 0; i < disks.size(); ++i) {
+			if (!listed[i])
+				continue;
+			auto& disk = disks[i];
+			disk.arc_dir_entries.resize(volumes[i].entries_n);
+			std::memcpy(disk.arc_dir_entries.data(), volumes[i].entries.data(), volumes[i].entries.size());
+			disk.names_arena = std::move(volumes[i].names);
+			disk.has_OS2_EA = (volumes[i].flags & cached_OS2_EA) != 0;
+			disk.counter = 0;
+		}
+	}
+	catch (std::bad_alloc&) {
+		for (auto& disk : disks) {
+			disk.arc_dir_entries.clear();
+			disk.names_arena.clear();
+		}
+		return false;
+	}
+	plugin_config.log_print("Info# Listing is loaded from the cache");
+	return true;
+}
+
+void whole_disk_t::save_to_cache(const std::vector<char>& listed, const std::vector<uint64_t>& fs_hashes) const {
+	size_t total_entries = 0;
+	for (const auto& disk : disks) {
+		total_entries += disk.arc_dir_entries.size();
+	}
+	if (total_entries < plugin_config.listing_cache_min_entries)
+		return;
+	const cached_image_id_t image_id{ archname.data(), image_file_size, get_file_mtime(hArchFile) };
+	try {
+		std::vector<cached_volume_t> volumes(disks.size());
+		for (size_t i = 0; i < disks.size(); ++i) {
+			const auto& disk = disks[i];
+			auto& volume = volumes[i];
+			volume.fs_hash = fs_hashes[i];
+			volume.flags = (listed[i] ? cached_listed : 0) | (disk.has_OS2_EA ? cached_OS2_EA : 0);
+			if (!listed[i])
+				continue;
+			volume.entries_n = static_cast<uint32_t>(disk.arc_dir_entries.size());
+			auto entries_bytes = reinterpret_cast<const uint8_t*>(disk.arc_dir_entries.data());
+			volume.entries.assign(entries_bytes, entries_bytes + disk.arc_dir_entries.size() * sizeof(arc_dir_entry_t));
+			volume.names = disk.names_arena;
+		}
+		if (!save_listing_cache(plugin_config.listing_cache_dir.data(), image_id, sizeof(arc_dir_entry_t), volumes,
+			plugin_config.listing_cache_max_files)) {
+			plugin_config.log_print_dbg("Warning# Could not save the listing cache");
+		}
+	}
+	catch (std::bad_alloc&) {
+		// Cache is optional
+	}
+}
+
+//! Pool for opening the image: partitions and directories are read in parallel. nullptr if listing_threads == 1.
+static std::unique_ptr<work_stealing_pool_t> make_open_pool() {
+	size_t threads = plugin_config.listing_threads ?
+		plugin_config.listing_threads : work_stealing_pool_t::default_threads();
+	if (threads <= 1)
+		return nullptr;
+	try {
+		return std::make_unique<work_stealing_pool_t>(threads);
+	}
+	catch (std::exception& ex) {
+		plugin_config.log_print_dbg("Warning# Failed to start threads (%s), reading the image serially.", ex.what());
+		return nullptr;
+	}
+}
+
+//! Calls f(i) for each i in [0, n) -- in the pool, if any, waiting for all of them. f should not throw.
+template<typename F>
+static void run_for_each(work_stealing_pool_t* pool, size_t n, const F& f) {
+	if (!pool || n < 2) {
+		for (size_t i = 0; i < n; ++i) {
+			f(i);
+		}
+		return;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		pool->submit([&f, i]() { f(i); });
+	}
+	pool->wait();
+}
+
 //------- FAT_image_t implementation -----------------------------
 // Though using methods of the whole_disk_t would be more OOP-style, code verbosity becomes too large for me (Indrekis)
 size_t FAT_image_t::get_sector_size() const {
@@ -374,14 +806,21 @@ file_handle_t FAT_image_t::get_archive_handler() const {
 	return whole_disk_ptr->hArchFile;
 }
 
-size_t FAT_image_t::get_image_file_size() const {
+uint64_t FAT_image_t::get_image_file_size() const {
 	return whole_disk_ptr->image_file_size;
 }
 
+const uint8_t* FAT_image_t::get_image_view(uint64_t offset, size_t size) const {
+	if (!whole_disk_ptr->image_view || offset > whole_disk_ptr->image_file_size ||
+		size > whole_disk_ptr->image_file_size - offset) {
+		return nullptr;
+	}
+	return whole_disk_ptr->image_view + offset;
+}
+
 int FAT_image_t::process_bootsector(bool read_bootsec) {
 	if(read_bootsec){
-		set_file_pointer(get_archive_handler(), boot_sector_offset);
-		auto result = read_file(get_archive_handler(), &bootsec, get_sector_size());
+		auto result = read_file_at(get_archive_handler(), &bootsec, get_sector_size(), boot_sector_offset);
 		if (result != get_sector_size()) {
 			return E_EREAD;
 		}
@@ -445,11 +884,13 @@ int FAT_image_t::process_bootsector(bool read_bootsec) {
 	plugin_config.log_print("Info# Sectors per track: %d", bootsec.BPB_SecPerTrk);
 	plugin_config.log_print("Info# Heads: %d", bootsec.BPB_NumHeads);
 	plugin_config.log_print("Info# Bytes in cluster: %d", cluster_size_m);
-	plugin_config.log_print("Info# FAT1 area offset: 0x%010X", FAT1area_off_m);
-	plugin_config.log_print("Info# Root area offset: 0x%010X", rootarea_off_m);
-	plugin_config.log_print("Info# Data area offset: 0x%010X", dataarea_off_m);
+	plugin_config.log_print("Info# FAT1 area offset: 0x%010llX", static_cast<unsigned long long>(FAT1area_off_m));
+	plugin_config.log_print("Info# Root area offset: 0x%010llX", static_cast<unsigned long long>(rootarea_off_m));
+	plugin_config.log_print("Info# Data area offset: 0x%010llX", static_cast<unsigned long long>(dataarea_off_m));
 	plugin_config.log_print("Info# --------- ");
 
+	if (bootsec.BPB_bytesPerSec != 0 && bootsec.BPB_SecPerClus != 0)
+		data_clusters_m = get_data_clusters_in_volume();
 	FAT_type = detect_FAT_type();
 
 	switch (FAT_type) {
@@ -581,11 +1022,7 @@ int FAT_image_t::process_DOS1xx_image() {
 	uint8_t media_descr = 0;
 
 	// Using get_boot_sector_offset() is questionable here -- partitions should have BPB, but it does not harm.
-	auto res = set_file_pointer( get_archive_handler(), get_boot_sector_offset() + get_sector_size() );
-	if (!res) {
-		return E_EREAD;
-	}
-	auto rdres = read_file(get_archive_handler(), &media_descr, 1);
+	auto rdres = read_file_at(get_archive_handler(), &media_descr, 1, get_boot_sector_offset() + get_sector_size());
 	if (rdres != 1) {
 		return E_EREAD;
 	}
@@ -669,6 +1106,34 @@ int FAT_image_t::process_DOS1xx_image() {
 
 int FAT_image_t::load_FAT() {
 	const size_t fat_size_bytes = get_bytes_per_FAT();
+	fat_view_m = get_image_view(get_FAT1_area_offset(), fat_size_bytes);
+	if (fat_view_m) {
+		fattable = std::vector<uint8_t>{};
+		decode_FAT();
+		return 0;
+	}
+	if (FAT_type != FAT12_type && plugin_config.paged_FAT_threshold != 0 && 
+		fat_size_bytes > plugin_config.paged_FAT_threshold) {
+		fattable = std::vector<uint8_t>{};
+		try {
+			paged_fat_m = std::make_shared<paged_FAT_t>(get_archive_handler(), get_FAT1_area_offset(),
+				fat_size_bytes, plugin_config.paged_FAT_cache_pages);
+		}
+		catch (std::bad_alloc&) {
+			return E_NO_MEMORY;
+		}
+		// Root directory and the first-level directories are usually near the root cluster.
+		size_t root_pos = 0;
+		if (FAT_type == FAT32_type) {
+			root_pos = static_cast<size_t>(bootsec.EBPB_FAT32.BS_RootFirstClus) * 4; //-V112
+		}
+		if (root_pos < fat_size_bytes) {
+			paged_fat_m->prefetch(root_pos / paged_FAT_t::page_size, plugin_config.paged_FAT_prefetch_pages);
+		}
+		plugin_config.log_print("Info# Paged FAT: %zu bytes, prefetched %zu pages", 
+			fat_size_bytes, paged_fat_m->get_loaded_pages());
+		return 0;
+	}
 	try {
 		fattable.reserve(fat_size_bytes); // To minimize overcommit
 		fattable.resize(fat_size_bytes);
@@ -677,16 +1142,34 @@ int FAT_image_t::load_FAT() {
 		return E_NO_MEMORY;
 	}
 	// Read FAT table
-	set_file_pointer(get_archive_handler(), get_FAT1_area_offset());
-	auto result = read_file(get_archive_handler(), fattable.data(), fat_size_bytes);
+	auto result = read_file_at(get_archive_handler(), fattable.data(), fat_size_bytes, get_FAT1_area_offset());
 	if (result != fat_size_bytes)
 	{
 		plugin_config.log_print_dbg("Error# Failed to read FAT from the image: %zd", result);
 		return E_EREAD;
 	}
+	decode_FAT();
 	return 0;
 }
 
+void FAT_image_t::decode_FAT() {
+	next_cluster_m = std::vector<uint32_t>{};
+	// FAT16 entries are already aligned words, and its array twice as large as the FAT misses the cache
+	// more on the fragmented chains -- see bench/FAT_decode_bench.cpp. So only FAT12 is decoded.
+	if (FAT_type != FAT12_type)
+		return;
+	// Entries past the largest 12-bit cluster number are not reachable from the chains
+	auto fat = get_FAT_bytes();
+	fat = fat.first(std::min<size_t>(fat.size(), 0x1000 / 2 * 3));
+	try {
+		next_cluster_m.resize(FAT12_entries(fat.size()));
+	}
+	catch (std::bad_alloc&) {
+		return; // next_cluster_FAT12() is used then
+	}
+	decode_FAT12(fat.data(), fat.size(), next_cluster_m.data());
+}
+
 uint64_t FAT_image_t::get_total_sectors_in_volume() const {
 	uint64_t sectors = 0;
 	if (bootsec.BPB_TotSec16 != 0) {
@@ -732,7 +1215,7 @@ FAT_image_t::FAT_types FAT_image_t::detect_FAT_type() const {
 	if(bytes_per_sector == 0){
 		return FAT_image_t::exFAT_type;
 	}
-	auto clusters = get_data_clusters_in_volume();
+	auto clusters = data_clusters_m;
 	if (strncmp(bootsec.EBPB_FAT.BS_FilSysType, "FAT12   ", 8) == 0) {
 		if (clusters > max_cluster_FAT(FAT12_type)) {
 			plugin_config.log_print_dbg("Warning# String \"FAT12\" found in boot, "
@@ -792,39 +1275,121 @@ FAT_image_t::FAT_types FAT_image_t::detect_FAT_type() const {
 	return FAT_image_t::unknown_FS_type; // Unknown format
 }
 
-int FAT_image_t::extract_to_file(file_handle_t hUnpFile, uint32_t idx) {
+uint64_t FAT_image_t::get_fs_hash() const {
+	uint64_t hash = hash_bytes(&boot_sector_offset, sizeof(boot_sector_offset), FAT_type);
+	hash = hash_bytes(&bootsec, sizeof(bootsec), hash);
+	const auto fat = get_FAT_bytes(); // Empty for the paged FAT
+	return hash_bytes(fat.data(), fat.size(), hash);
+}
+
+int FAT_image_t::extract_to_file(file_handle_t hUnpFile, uint32_t idx, char* dest) {
 	try { // For bad allocation
 		const auto& cur_entry = arc_dir_entries[idx];
-		uint32_t nextclus = cur_entry.FirstClus;
 		size_t remaining = cur_entry.FileSize;
-		std::vector<char> buff(get_cluster_size());
-		while (remaining > 0)
-		{
-			if ( (nextclus <= 1) || (nextclus >= min_end_of_chain_FAT()) )
-			{
-				plugin_config.log_print_dbg("Error# Wrong cluster number in chain: %d in file: %s",
-					nextclus, cur_entry.PathName.data());
+		if (remaining == 0) {
+			if (whole_disk_t::pLocProcessData && whole_disk_t::pLocProcessData(dest, 0) == 0) {
 				close_file(hUnpFile);
-				return E_UNKNOWN_FORMAT;
+				return E_EABORTED;
 			}
-			set_file_pointer(get_archive_handler(), cluster_to_image_off(nextclus));
-			size_t towrite = std::min<size_t>(get_cluster_size(), remaining);
-			size_t result = read_file(get_archive_handler(), buff.data(), towrite);
-			if (result != towrite)
-			{
-				close_file(hUnpFile);
-				return E_EREAD;
+			return 0;
+		}
+		const uint32_t first_cluster = cur_entry.FirstClus;
+		auto is_valid_cluster = [min_end_of_chain = min_end_of_chain_FAT()](uint32_t cluster) {
+			return (cluster > 1) && (cluster < min_end_of_chain); };
+		auto report_wrong_cluster = [&](uint32_t cluster) {
+			plugin_config.log_print_dbg("Error# Wrong cluster number in chain: %d in file: %s",
+				cluster, get_entry_path(idx).data());
+			close_file(hUnpFile);
+			return E_UNKNOWN_FORMAT;
+		};
+		if (!is_valid_cluster(first_cluster)) {
+			return report_wrong_cluster(first_cluster);
+		}
+		// Extents of the file, the chain walk is limited by the file size
+		const size_t file_clusters = (remaining + get_cluster_size() - 1) / get_cluster_size();
+		std::vector<cluster_run_t> runs;
+		uint32_t stop_cluster = 0;
+		const size_t chain_clusters = get_chain_runs(first_cluster, file_clusters, runs,
+			is_valid_cluster, stop_cluster);
+
+		// Runs are read by chunks of whole clusters, the last chunk of the file could be shorter
+		const size_t chunk_size = std::max<size_t>(
+			plugin_config.extract_chunk_size / get_cluster_size(), 1) * get_cluster_size();
+		struct chunk_t {
+			uint64_t offset;
+			size_t size;
+		};
+		std::vector<chunk_t> chunks;
+		for (const auto& run : runs) {
+			uint64_t run_offset = cluster_to_image_off(run.first);
+			size_t run_remaining = std::min<size_t>(static_cast<size_t>(run.count) * get_cluster_size(), remaining);
+			while (run_remaining > 0) {
+				size_t size = std::min(chunk_size, run_remaining);
+				chunks.push_back({ run_offset, size });
+				run_offset += size;
+				run_remaining -= size;
+				remaining -= size;
 			}
-			result = write_file(hUnpFile, buff.data(), towrite);
-			if (result != towrite)
-			{
-				close_file(hUnpFile);
+		}
+
+		// Progress is reported by chunks, which also allows to cancel the extraction of large files
+		auto report_progress = [&](size_t size) {
+			if (whole_disk_t::pLocProcessData && whole_disk_t::pLocProcessData(dest, static_cast<int>(size)) == 0)
+				return E_EABORTED;
+			return 0;
+		};
+		auto write_chunk = [&](size_t chunk, const char* data) {
+			size_t result = write_file(hUnpFile, data, chunks[chunk].size);
+			if (result != chunks[chunk].size)
 				return E_EWRITE;
+			return report_progress(chunks[chunk].size);
+		};
+		int res = 0;
+		if (plugin_config.zero_copy_extract) {
+			// Chunks are copied by the host until it refuses, the rest -- by the buffered copy below
+			size_t copied_chunks = 0;
+			for (; copied_chunks < chunks.size() && res == 0; ++copied_chunks) {
+				auto& chunk = chunks[copied_chunks];
+				size_t copied = copy_file_range_at(get_archive_handler(), chunk.offset, hUnpFile, chunk.size);
+				if (copied != chunk.size) {
+					// Silent fallback would hide the broken fast path -- reported once per process
+					static std::atomic<bool> fallback_reported{ false };
+					if (!fallback_reported.exchange(true))
+						plugin_config.log_print_dbg("Info# Zero-copy extraction is not available for %s: "
+							"%zu of %zu bytes copied by the host, the rest by the buffered copy", dest, copied, chunk.size);
+					chunk.offset += copied;
+					chunk.size -= copied;
+					if (copied > 0)
+						res = report_progress(copied);
+					break;
+				}
+				res = report_progress(copied);
 			}
-			if (remaining > get_cluster_size()) { remaining -= get_cluster_size(); } //-V104 //-V101
-			else { remaining = 0; }
-
-			nextclus = next_cluster_FAT(nextclus); // TODO: fix if too large cluster number -- test if fixed
+			chunks.erase(chunks.begin(), chunks.begin() + copied_chunks);
+		}
+		if (res == 0 && !chunks.empty()) {
+			if (whole_disk_ptr->image_view) { // Reading is done by the page faults, no reason for the pipeline
+				for (size_t chunk = 0; chunk < chunks.size() && res == 0; ++chunk) {
+					const auto* data = reinterpret_cast<const char*>(get_image_view(chunks[chunk].offset, chunks[chunk].size));
+					res = data ? write_chunk(chunk, data) : E_EREAD;
+				}
+			}
+			else {
+				copy_pipeline_t pipeline(plugin_config.extract_buffers, std::min<size_t>(chunk_size, cur_entry.FileSize));
+				res = pipeline.run(chunks.size(),
+					[&](size_t chunk, char* buffer) {
+						size_t result = read_file_at(get_archive_handler(), buffer, chunks[chunk].size, chunks[chunk].offset);
+						return result == chunks[chunk].size ? 0 : E_EREAD;
+					},
+					write_chunk);
+			}
+		}
+		if (res != 0) {
+			close_file(hUnpFile);
+			return res;
+		}
+		if (chain_clusters < file_clusters) { // Chain is broken before the end of file, what was available is written
+			return report_wrong_cluster(stop_cluster);
 		}
 		return 0;
 	}
@@ -835,20 +1400,22 @@ int FAT_image_t::extract_to_file(file_handle_t hUnpFile, uint32_t idx) {
 
 void FAT_image_t::LFN_accumulator_t::process_LFN_record(const FATxx_dir_entry_t* entry) {
 	auto LFN_record = as_LFN_record(entry);
+	const uint32_t ordinal = LFN_record->get_LFN_ordinal();
+	const bool valid_ordinal = ordinal >= 1 && ordinal <= VFAT_LFN_dir_entry_t::max_LFN_ordinal;
 	if (!are_processing()) {
-		if (!LFN_record->is_LFN_record_valid() || !LFN_record->is_first_LFN()) {
+		if (!LFN_record->is_LFN_record_valid() || !LFN_record->is_first_LFN() || !valid_ordinal) {
 			return; // No record
 		}
 		start_processing(LFN_record);
 	}
 	else {
-		if (!LFN_record->is_LFN_record_valid()) {
+		if (!LFN_record->is_LFN_record_valid() || !valid_ordinal) {
 			abort_processing();
 		}
 		else if (LFN_record->is_first_LFN()) { // Should restart processing 
 			start_processing(LFN_record);
 		}
-		else if (cur_LFN_CRC != LFN_record->LFN_DOS_name_CRC) {
+		else if (cur_LFN_CRC != LFN_record->LFN_DOS_name_CRC || ordinal > parts_number) {
 			abort_processing();
 		}
 		else {
@@ -857,62 +1424,214 @@ void FAT_image_t::LFN_accumulator_t::process_LFN_record(const FATxx_dir_entry_t*
 	}
 }
 
-// root passed by copy to avoid problems while relocating vector
-int FAT_image_t::load_file_list_recursively(minimal_fixed_string_t<MAX_PATH> root, uint32_t firstclus, uint32_t depth) //-V813
-{
-	if (root.is_empty()) { // Initial reading
-		counter = 0;
-		arc_dir_entries.clear();
+int FAT_image_t::start_file_list(dir_listing_t& root_listing, work_stealing_pool_t* pool) {
+	counter = 0;
+	arc_dir_entries.clear();
+	names_arena.clear();
+	try {
+		return load_file_list_recursively(root_listing, 0, 0, pool);
+	}
+	catch (std::bad_alloc&) {
+		return E_NO_MEMORY;
 	}
+}
 
-	if (firstclus == 0 && FAT_type == FAT32_type) {
-		// For exotic implementations, if BS_RootFirstClus == 0, will behave as expected
-		firstclus = bootsec.EBPB_FAT32.BS_RootFirstClus;
+int FAT_image_t::finish_file_list(dir_listing_t& root_listing, int start_res) {
+	// Partially read tree is kept in case of the errors, as for the serial reading
+	try {
+		merge_listing(root_listing, arc_dir_entry_t::no_parent);
 	}
+	catch (std::bad_alloc&) {
+		arc_dir_entries.clear();
+		names_arena.clear();
+		return E_NO_MEMORY;
+	}
+	arc_dir_entries.shrink_to_fit();
+	names_arena.shrink_to_fit();
+	return start_res;
+}
 
-	size_t portion_size = 0;
-	if (firstclus == 0)
-	{   // Read whole FAT12/16 dir at once
-		set_file_pointer(get_archive_handler(), get_root_area_offset());
-		portion_size = get_root_dir_size();
+void FAT_image_t::merge_listing(dir_listing_t& listing, uint32_t parent_idx) {
+	has_OS2_EA = has_OS2_EA || listing.has_OS2_EA;
+	auto names_base = static_cast<uint32_t>(names_arena.size());
+	names_arena.insert(names_arena.end(), listing.names.begin(), listing.names.end());
+	auto subdir = listing.subdirs.begin();
+	for (uint32_t i = 0; i < listing.entries.size(); ++i) {
+		auto idx = static_cast<uint32_t>(arc_dir_entries.size());
+		auto& entry = arc_dir_entries.emplace_back(listing.entries[i]);
+		entry.name_offset += names_base;
+		entry.parent = parent_idx;
+		if (subdir != listing.subdirs.end() && subdir->first == i) {
+			if (subdir->second->is_pending)
+				add_pending_dir(idx, *subdir->second);
+			else
+				merge_listing(*subdir->second, idx);
+			subdir->second.reset(); // Already merged
+			++subdir;
+		}
 	}
-	else {
-		set_file_pointer(get_archive_handler(), cluster_to_image_off(firstclus));
-		portion_size = static_cast<size_t>(get_cluster_size());
+}
+
+void FAT_image_t::add_pending_dir(uint32_t idx, const dir_listing_t& listing) {
+	auto& pending = pending_dirs_m[idx];
+	pending.first_cluster = listing.first_cluster;
+	pending.depth = listing.depth;
+	auto* pool = whole_disk_ptr->prefetcher.pool.get();
+	if (!pool)
+		return;
+	auto prefetch = std::make_shared<dir_prefetch_t>();
+	auto* stop = &whole_disk_ptr->prefetcher.stop;
+	pool->submit([this, prefetch, stop, first_cluster = pending.first_cluster, depth = pending.depth]() {
+		{
+			std::lock_guard<std::mutex> lock(prefetch->mux);
+			if (prefetch->state != dir_prefetch_t::queued || *stop)
+				return; // Already read by the ReadHeader() or the archive is being closed
+			prefetch->state = dir_prefetch_t::running;
+		}
+		try {
+			load_file_list_recursively(prefetch->listing, first_cluster, depth, nullptr);
+		}
+		catch (std::bad_alloc&) {
+			plugin_config.log_print_dbg("Warning# Not enough memory to list the directory at cluster %d.", first_cluster);
+		}
+		{
+			std::lock_guard<std::mutex> lock(prefetch->mux);
+			prefetch->state = dir_prefetch_t::done;
+		}
+		prefetch->cv.notify_all();
+		});
+	pending.prefetch = std::move(prefetch);
+}
+
+void FAT_image_t::expand_pending_dir(uint32_t idx) {
+	auto it = pending_dirs_m.find(idx);
+	if (it == pending_dirs_m.end())
+		return;
+	auto pending = std::move(it->second);
+	pending_dirs_m.erase(it);
+	dir_listing_t own_listing;
+	dir_listing_t* listing = &own_listing;
+	if (pending.prefetch) {
+		std::unique_lock<std::mutex> lock(pending.prefetch->mux);
+		if (pending.prefetch->state == dir_prefetch_t::queued) {
+			pending.prefetch->state = dir_prefetch_t::running; // Not started yet -- reading it here
+		}
+		else {
+			pending.prefetch->cv.wait(lock, [&pending] { return pending.prefetch->state == dir_prefetch_t::done; });
+			listing = &pending.prefetch->listing;
+		}
 	}
-	size_t records_number = portion_size / sizeof(FATxx_dir_entry_t);
-	std::unique_ptr<FATxx_dir_entry_t[]> sector;
+	// As for the eager listing, errors in the subdirectories are not fatal -- they are just not listed
 	try {
-		sector = std::make_unique<FATxx_dir_entry_t[]>(records_number);
+		if (listing == &own_listing)
+			load_file_list_recursively(own_listing, pending.first_cluster, pending.depth, nullptr);
+		merge_listing(*listing, idx);
 	}
 	catch (std::bad_alloc&) {
-		return E_NO_MEMORY;
+		plugin_config.log_print_dbg("Warning# Not enough memory to list the directory at cluster %d.", pending.first_cluster);
+	}
+}
+
+template<typename reader_t>
+int FAT_image_t::load_directory(const reader_t& next_of, dir_listing_t& listing, uint32_t firstclus, uint32_t depth,
+	work_stealing_pool_t* pool)
+{
+	constexpr unsigned FAT_bits = reader_t::FAT_width;
+	using traits = FAT_traits_t<FAT_bits>;
+	if constexpr (FAT_bits == 32) {
+		if (firstclus == 0) {
+			// For exotic implementations, if BS_RootFirstClus == 0, will behave as expected
+			firstclus = bootsec.EBPB_FAT32.BS_RootFirstClus;
+		}
 	}
 
-	if (firstclus >= max_normal_cluster_FAT()) {
+	if (firstclus >= traits::max_normal_cluster) {
 		plugin_config.log_print_dbg("Warning# Unusual first "
-			"clusters number:  %d of %d", firstclus, max_normal_cluster_FAT());
+			"clusters number:  %d of %d", firstclus, traits::max_normal_cluster);
 	}
-	if ( (firstclus == 1) || (firstclus >= max_cluster_FAT()) ) {
+	if ( (firstclus == 1) || (firstclus >= traits::max_cluster) ) {
 		plugin_config.log_print_dbg("Error# Wrong first "
-			"clusters number: %d of 2-%d", firstclus, max_cluster_FAT());
+			"clusters number: %d of 2-%d", firstclus, traits::max_cluster);
 		return E_UNKNOWN_FORMAT;
 	}
-	size_t result = read_file(get_archive_handler(), sector.get(), portion_size);
-	if (result != portion_size) {
-		return E_EREAD;
+
+	// Directory is read by portions: whole FAT12/16 root dir at once, else -- runs of consecutive clusters
+	struct portion_t {
+		uint64_t offset;
+		size_t size;
+	};
+	std::vector<portion_t> portions;
+	uint32_t chain_stop = 0;
+	size_t chain_clusters = 0;
+	size_t max_chain_clusters = std::max<size_t>(static_cast<size_t>(data_clusters_m), 1);
+	if (firstclus == 0)
+	{
+		portions.push_back({ get_root_area_offset(), get_root_dir_size() });
+	}
+	else {
+		std::vector<cluster_run_t> runs;
+		chain_clusters = get_chain_runs_FAT(next_of, firstclus, max_chain_clusters, runs,
+			[](uint32_t cluster) { return cluster > 1 && cluster < traits::max_normal_cluster; }, chain_stop);
+		const size_t clusters_per_read = std::max<size_t>(max_dir_read_size / get_cluster_size(), 1);
+		for (const auto& run : runs) {
+			for (uint32_t done = 0; done < run.count; ) {
+				auto n = static_cast<uint32_t>(std::min<size_t>(run.count - done, clusters_per_read));
+				portions.push_back({ cluster_to_image_off(run.first + done), static_cast<size_t>(n) * get_cluster_size() });
+				done += n;
+			}
+		}
+	}
+
+	std::unique_ptr<FATxx_dir_entry_t[]> sector_buff; // Not used if the image is mapped
+	const FATxx_dir_entry_t* sector = nullptr;
+	std::vector<uint64_t> visit_mask; // See classify_dir_records()
+	size_t max_portion_size = 0;
+	for (const auto& portion : portions) {
+		max_portion_size = std::max(max_portion_size, portion.size);
+	}
+	try {
+		visit_mask.resize((max_portion_size / sizeof(FATxx_dir_entry_t) + 63) / 64);
+		if (!whole_disk_ptr->image_view) {
+			sector_buff = std::make_unique<FATxx_dir_entry_t[]>(max_portion_size / sizeof(FATxx_dir_entry_t));
+			sector = sector_buff.get();
+		}
+	}
+	catch (std::bad_alloc&) {
+		return E_NO_MEMORY;
 	}
+	// Directory is parsed in place when mapped, else -- read into the buffer
+	auto load_portion = [&](const portion_t& portion) -> bool {
+		if (whole_disk_ptr->image_view) {
+			sector = reinterpret_cast<const FATxx_dir_entry_t*>(get_image_view(portion.offset, portion.size));
+			return sector != nullptr; // Out of the image
+		}
+		size_t result = read_file_at(get_archive_handler(), sector_buff.get(), portion.size, portion.offset);
+		return result == portion.size;
+	};
 
 	LFN_accumulator_t current_LFN;
-	do {
-		size_t entry_in_cluster = 0;
-		while ((entry_in_cluster < records_number) && (!sector[entry_in_cluster].is_dir_record_free()))
+	for (const auto& portion : portions) {
+		if (!load_portion(portion)) {
+			return E_EREAD;
+		}
+		size_t records_number = portion.size / sizeof(FATxx_dir_entry_t);
+		// Bulk pre-pass: the loop below visits only the records which are not just skipped
+		const size_t records_end = classify_dir_records(reinterpret_cast<const uint8_t*>(sector), records_number,
+			visit_mask.data());
+		auto next_visited = [&](size_t from) {
+			size_t next = find_next_bit(visit_mask.data(), from, records_end);
+			if (next != from && current_LFN.are_processing())
+				current_LFN.abort_processing(); // Skipped records break the LFN sequence, as in the checks below
+			return next;
+		};
+		size_t entry_in_cluster = next_visited(0);
+		while (entry_in_cluster < records_end)
 		{
 			if (sector[entry_in_cluster].is_dir_record_longname_part()) {
 				if (plugin_config.use_VFAT) {
 					current_LFN.process_LFN_record(&sector[entry_in_cluster]);
 				}
-				entry_in_cluster++;
+				entry_in_cluster = next_visited(entry_in_cluster + 1);
 				continue;
 			}
 
@@ -931,108 +1650,133 @@ int FAT_image_t::load_file_list_recursively(minimal_fixed_string_t<MAX_PATH> roo
 			{
 				if(current_LFN.are_processing())
 					current_LFN.abort_processing();
-				entry_in_cluster++;
+				entry_in_cluster = next_visited(entry_in_cluster + 1);
 				continue;
 			}
 
-			arc_dir_entries.emplace_back();
-			auto& newentryref = arc_dir_entries.back();
-			newentryref.FileAttr = sector[entry_in_cluster].DIR_Attr;
-			newentryref.PathName.push_back(root); // Empty root is OK, "\\" OK too
+			FATxx_dir_entry_t cur_entry = sector[entry_in_cluster]; // Copy -- process_E5() modifies it, sector can be read-only
+			minimal_fixed_string_t<MAX_PATH> name;
 			uint32_t invalid_chars = 0;
 			if (plugin_config.use_VFAT && current_LFN.are_processing()) {
-				if (current_LFN.cur_LFN_CRC == VFAT_LFN_dir_entry_t::LFN_checksum(sector[entry_in_cluster].DIR_Name)) {
-					newentryref.PathName.push_back(current_LFN.cur_LFN_name);
-				}
-				else {
-					auto res = sector[entry_in_cluster].process_E5();
+				// Short name is used if the LFN belongs to another entry or could not be converted
+				if (current_LFN.cur_LFN_CRC != VFAT_LFN_dir_entry_t::LFN_checksum(cur_entry.DIR_Name) ||
+					!current_LFN.get_LFN_name(name)) {
+					auto res = cur_entry.process_E5();
 					if(!res)
 						plugin_config.log_print_dbg("Warning# E5 occurred at first symbol.");
-					invalid_chars = sector[entry_in_cluster].dir_entry_name_to_str(newentryref.PathName);
+					invalid_chars = cur_entry.dir_entry_name_to_str(name);
 					// No OS/2 EA on FAT32
 				}
 				current_LFN.abort_processing();
 			}
 			else {
-				auto res = sector[entry_in_cluster].process_E5();
+				auto res = cur_entry.process_E5();
 				if (!res)
 					plugin_config.log_print_dbg("Warning# E5 occurred at first symbol.");
-				invalid_chars = sector[entry_in_cluster].dir_entry_name_to_str(newentryref.PathName);
+				invalid_chars = cur_entry.dir_entry_name_to_str(name);
 				if (invalid_chars == FATxx_dir_entry_t::LLDE_OS2_EA) {
 					plugin_config.log_print_dbg("Info# OS/2 Extended attributes found.");
-					has_OS2_EA = true;
+					listing.has_OS2_EA = true;
 				}
 			}
-
-			newentryref.FileTime = sector[entry_in_cluster].get_file_datetime();
-			newentryref.FileSize = sector[entry_in_cluster].DIR_FileSize;
-			newentryref.FirstClus = get_first_cluster(sector[entry_in_cluster]);
-
-			if (sector[entry_in_cluster].is_dir_record_dir()) {
-				newentryref.PathName.push_back('\\'); // Neccessery for empty dirs to be "enterable"
+			if (cur_entry.is_dir_record_dir()) {
+				name.push_back('\\'); // Neccessery for empty dirs to be "enterable"
 			}
+
+			auto new_idx = static_cast<uint32_t>(listing.entries.size());
+			listing.entries.emplace_back();
+			auto& newentryref = listing.entries.back(); // Invalidated by the recursive call below
+			newentryref.name_offset = static_cast<uint32_t>(listing.names.size());
+			listing.names.insert(listing.names.end(), name.data(), name.data() + name.size() + 1);
+			newentryref.FileAttr = cur_entry.DIR_Attr;
+			newentryref.FileTime = cur_entry.get_file_datetime();
+			newentryref.FileSize = cur_entry.DIR_FileSize;
+			newentryref.FirstClus = get_first_cluster<FAT_bits>(cur_entry);
 			if (depth > plugin_config.max_depth) {
 				plugin_config.log_print_dbg("Too many nested directories: %d.", depth);
 				break;
 			}
-			if (sector[entry_in_cluster].is_dir_record_dir() &&
-				(newentryref.FirstClus < max_cluster_FAT()) && (newentryref.FirstClus > 0x1)
+			if (cur_entry.is_dir_record_dir() &&
+				(newentryref.FirstClus < traits::max_cluster) && (newentryref.FirstClus > 0x1)
 				&& (depth <= plugin_config.max_depth))  //-V560 // Always true after the previous if, but leaving it here for clarity
 			{
 				if(invalid_chars > plugin_config.max_invalid_chars_in_dir && invalid_chars != FATxx_dir_entry_t::LLDE_OS2_EA) {
-					plugin_config.log_print_dbg("Warning# Invalid characters in directory name: %s, skipping", newentryref.PathName.data());
+					plugin_config.log_print_dbg("Warning# Invalid characters in directory name: %s, skipping", name.data());
 				}
 				else {
-					load_file_list_recursively(newentryref.PathName, newentryref.FirstClus, depth + 1);
+					// Errors in the subdirectories are not fatal -- they are just not listed
+					auto* subdir = listing.subdirs.emplace_back(new_idx, std::make_unique<dir_listing_t>()).second.get();
+					uint32_t subdir_clus = newentryref.FirstClus;
+					auto load_subdir = [this, next_of, subdir, subdir_clus, depth, pool]() {
+						try {
+							load_directory(next_of, *subdir, subdir_clus, depth + 1, pool);
+						}
+						catch (std::bad_alloc&) {
+							plugin_config.log_print_dbg("Warning# Not enough memory to list the directory at cluster %d.", subdir_clus);
+						}
+					};
+					if (lazy_listing_m) {
+						subdir->is_pending = true;
+						subdir->first_cluster = subdir_clus;
+						subdir->depth = depth + 1;
+					}
+					else if (pool)
+						pool->submit(load_subdir);
+					else
+						load_subdir();
 				}
 			}
-			++entry_in_cluster;
+			entry_in_cluster = next_visited(entry_in_cluster + 1);
 		}
 		if (entry_in_cluster < records_number) { return 0; }
-		if (firstclus == 0)
-		{
-			break; // We already processed FAT12/16 root dir
-		}
-		else {
-			firstclus = next_cluster_FAT(firstclus);
-			if (firstclus >= max_normal_cluster_FAT() && !is_end_of_chain_FAT(firstclus)) {
-				plugin_config.log_print_dbg("Warning# Unusual next "
-					"clusters number: %d of %d", firstclus, max_normal_cluster_FAT());
-				break;
-			}
-			if ((firstclus <= 1) || ( (firstclus >= max_cluster_FAT()) && !is_end_of_chain_FAT(firstclus)) ) {
-				plugin_config.log_print_dbg("Error# Wrong next "
-					"clusters number: %d of 2-%d", firstclus, max_cluster_FAT());
-				break;
-			}
-			if (is_end_of_chain_FAT(firstclus)) {
-				break;
-			}
-
-			set_file_pointer(get_archive_handler(), cluster_to_image_off(firstclus)); //-V104
-		}
-		result = read_file(get_archive_handler(), sector.get(), portion_size);
-		if (result != portion_size) {
-			return E_EREAD;
-		}
-	} while (true);
+	}
 
-	if (root.is_empty()) { // Initial finished
-		arc_dir_entries.shrink_to_fit();
+	// Whole chain is processed -- report, why it ended
+	if (firstclus == 0 || chain_stop >= traits::min_end_of_chain) {
+		return 0;
+	}
+	if (chain_stop >= traits::max_normal_cluster) {
+		plugin_config.log_print_dbg("Warning# Unusual next "
+			"clusters number: %d of %d", chain_stop, traits::max_normal_cluster);
+	}
+	else if (chain_stop <= 1) {
+		plugin_config.log_print_dbg("Error# Wrong next "
+			"clusters number: %d of 2-%d", chain_stop, traits::max_cluster);
+	}
+	else if (chain_clusters == max_chain_clusters) {
+		plugin_config.log_print_dbg("Warning# Directory cluster chain is longer than the volume -- "
+			"looped, starting from: %d", firstclus);
 	}
 	return 0;
 }
 
+int FAT_image_t::load_file_list_recursively(dir_listing_t& listing, uint32_t firstclus, uint32_t depth, work_stealing_pool_t* pool)
+{
+	auto load = [&](const auto& next_of) {
+		return load_directory(next_of, listing, firstclus, depth, pool);
+	};
+	switch (FAT_type) {
+	case FAT12_type:
+		return with_FAT_reader<12>(load);
+	case FAT16_type:
+		return with_FAT_reader<16>(load);
+	case FAT32_type:
+		return with_FAT_reader<32>(load);
+	default:
+		return E_UNKNOWN_FORMAT;
+	}
+}
+
 uint32_t FAT_image_t::get_first_cluster(const FATxx_dir_entry_t& dir_entry) const {
 	switch (FAT_type) {
 	case FAT12_type:
-		return dir_entry.get_first_cluster_FAT12();
+		return get_first_cluster<12>(dir_entry);
 		break;
 	case FAT16_type:
-		return dir_entry.get_first_cluster_FAT16();
+		return get_first_cluster<16>(dir_entry);
 		break;
 	case FAT32_type:
-		return dir_entry.get_first_cluster_FAT32();
+		return get_first_cluster<32>(dir_entry);
 		break;
 	default:
 		return 0;
@@ -1041,9 +1785,10 @@ uint32_t FAT_image_t::get_first_cluster(const FATxx_dir_entry_t& dir_entry) cons
 
 uint32_t FAT_image_t::next_cluster_FAT12(uint32_t firstclus) const
 {
-	const auto FAT_byte_pre = fattable.data() + ((firstclus * 3) >> 1); // firstclus + firstclus/2 //-V104
-	if (FAT_byte_pre >= fattable.data() + fattable.size()){
-		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, (3 * fattable.size())/2);
+	const auto fat = get_FAT_bytes();
+	const auto FAT_byte_pre = fat.data() + ((firstclus * 3) >> 1); // firstclus + firstclus/2 //-V104
+	if (FAT_byte_pre >= fat.data() + fat.size()){
+		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, (3 * fat.size())/2);
 		return max_cluster_FAT(FAT12_type);
 	}
 	//! Extract word, containing next cluster:
@@ -1054,37 +1799,35 @@ uint32_t FAT_image_t::next_cluster_FAT12(uint32_t firstclus) const
 
 uint32_t FAT_image_t::next_cluster_FAT16(uint32_t firstclus) const
 {
-	const auto FAT_byte_pre = fattable.data() + static_cast<size_t>(firstclus) * 2;
-	if( FAT_byte_pre >= fattable.data() + fattable.size() ) {
-		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, fattable.size()/2);
+	uint16_t next = 0;
+	if (!read_FAT_entry(firstclus, next)) {
+		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, get_bytes_per_FAT()/2);
 		return max_cluster_FAT(FAT16_type);
 	}
-	const uint16_t* word_ptr = reinterpret_cast<const uint16_t*>(FAT_byte_pre);
-	return *word_ptr;
+	return next;
 }
 
 uint32_t FAT_image_t::next_cluster_FAT32(uint32_t firstclus) const
 {
-	const auto FAT_byte_pre = fattable.data() + static_cast<size_t>(firstclus) * 4; //-V112
-	if (FAT_byte_pre >= fattable.data() + fattable.size()) {
-		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, fattable.size()/4);
+	uint32_t next = 0;
+	if (!read_FAT_entry(firstclus, next)) {
+		plugin_config.log_print_dbg("Warning# Too large cluster number %u of %zu present", firstclus, get_bytes_per_FAT()/4);
 		return max_cluster_FAT(FAT32_type);
 	}
-	const uint32_t* word_ptr = reinterpret_cast<const uint32_t*>(FAT_byte_pre); //-V206
-	return (*word_ptr) & 0x0F'FF'FF'FF; // Zero upper 4 bits
+	return next & 0x0F'FF'FF'FF; // Zero upper 4 bits
 }
 
 uint32_t FAT_image_t::next_cluster_FAT(uint32_t firstclus) const
 {
 	switch (FAT_type) {
 	case FAT12_type:
-		return next_cluster_FAT12(firstclus);
+		return next_cluster<12>(firstclus);
 		break;
 	case FAT16_type:
-		return next_cluster_FAT16(firstclus);
+		return next_cluster<16>(firstclus);
 		break;
 	case FAT32_type:
-		return next_cluster_FAT32(firstclus);
+		return next_cluster<32>(firstclus);
 		break;
 	default:
 		return 0;
@@ -1100,13 +1843,13 @@ uint32_t FAT_image_t::max_cluster_FAT(FAT_types type) const
 {
 	switch (type) {
 	case FAT12_type:
-		return 0xFF6;
+		return FAT_traits_t<12>::max_cluster;
 		break;
 	case FAT16_type:
-		return 0xFF'F6;
+		return FAT_traits_t<16>::max_cluster;
 		break;
 	case FAT32_type:
-		return 0xF'FF'FF'F6;
+		return FAT_traits_t<32>::max_cluster;
 		break;
 	default:
 		return 0;
@@ -1122,13 +1865,13 @@ uint32_t FAT_image_t::max_normal_cluster_FAT(FAT_types type) const
 {
 	switch (type) {
 	case FAT12_type:
-		return 0xFF0-1;
+		return FAT_traits_t<12>::max_normal_cluster;
 		break;
 	case FAT16_type:
-		return 0xFF'F0-1;
+		return FAT_traits_t<16>::max_normal_cluster;
 		break;
 	case FAT32_type:
-		return 0xF'FF'FF'F0-1;
+		return FAT_traits_t<32>::max_normal_cluster;
 		break;
 	default:
 		return 0;
@@ -1144,13 +1887,13 @@ uint32_t FAT_image_t::min_end_of_chain_FAT() const
 {
 	switch (FAT_type) {
 	case FAT12_type:
-		return 0xFF8;
+		return FAT_traits_t<12>::min_end_of_chain;
 		break;
 	case FAT16_type:
-		return 0xFF'F8;
+		return FAT_traits_t<16>::min_end_of_chain;
 		break;
 	case FAT32_type:
-		return 0xF'FF'FF'F8;
+		return FAT_traits_t<32>::min_end_of_chain;
 		break;
 	default:
 		return 0;
@@ -1168,8 +1911,7 @@ int FAT_image_t::search_for_bootsector() {
 	if (buffer == nullptr) {
 		return E_NO_MEMORY;
 	}
-	set_file_pointer(get_archive_handler(), 0);
-	auto result = read_file(get_archive_handler(), buffer.get(), plugin_config.search_for_boot_sector_range);
+	auto result = read_file_at(get_archive_handler(), buffer.get(), plugin_config.search_for_boot_sector_range, 0);
 	if (result != plugin_config.search_for_boot_sector_range) {
 		return E_EREAD;
 	}
@@ -1196,8 +1938,7 @@ int FAT_image_t::search_for_bootsector() {
 using archive_HANDLE = whole_disk_t*;
 
 int whole_disk_t::detect_MBR() {
-	set_file_pointer(hArchFile, 0);
-	auto result = read_file(hArchFile, &mbrs[0], sector_size);
+	auto result = read_file_at(hArchFile, &mbrs[0], sector_size, 0);
 	if (result != sector_size) {
 		return E_UNKNOWN_FORMAT;
 	}
@@ -1219,9 +1960,8 @@ int whole_disk_t::detect_MBR() {
 //! (parted) mkpart primary 2048s 100%
 int whole_disk_t::detect_GPT() {
 	// https://en.wikipedia.org/wiki/GUID_Partition_Table
-	set_file_pointer(hArchFile, sector_size); // Second sector -- LBA 1
 	GPT_PTH_t buff;
-	auto result = read_file(hArchFile, &buff, sector_size);
+	auto result = read_file_at(hArchFile, &buff, sector_size, sector_size); // Second sector -- LBA 1
 	if (result != sector_size) {
 		return E_UNKNOWN_FORMAT;
 	}
@@ -1292,9 +2032,9 @@ int whole_disk_t::process_MBR() {
 			auto cur_ext_start = mbrs[0].ptable[i].get_first_sec_by_LBA();
 			uint32_t EBR_offset = 0;
 			while (true) {
-				set_file_pointer(hArchFile, (cur_ext_start + EBR_offset) * sector_size); //-V106
 				mbrs.push_back({});
-				auto result = read_file(hArchFile, &mbrs.back(), sector_size);
+				auto result = read_file_at(hArchFile, &mbrs.back(), sector_size, 
+					(static_cast<uint64_t>(cur_ext_start) + EBR_offset) * sector_size); //-V106
 				if (result != sector_size) {
 					plugin_config.log_print_dbg("Warning# Error reading boot sector: %zd", result);
 					break;
@@ -1302,7 +2042,7 @@ int whole_disk_t::process_MBR() {
 				partition_info_t curp_ext;
 				// Starting sector for extended boot record (EBR) is a relative offset between this 
 				// EBR sector and the first sector of the logical partition
-				curp_ext.first_sector = cur_ext_start + EBR_offset
+				curp_ext.first_sector = static_cast<uint64_t>(cur_ext_start) + EBR_offset
 					+ mbrs.back().ptable[0].get_first_sec_by_LBA();
 				// EBR size does not accounts for unused sectors before the EBR and start of the partition
 				curp_ext.last_sector = curp_ext.first_sector
@@ -1327,7 +2067,99 @@ int whole_disk_t::process_MBR() {
 	return 0;
 }
 
-int whole_disk_t::process_volumes() {
+//! Recent process_volumes() results: the volumes layout and the parsed boot sectors, no FATs or listings yet
+class probe_cache_t {
+	struct probe_t {
+		minimal_fixed_string_t<MAX_PATH> archname;
+		uint64_t image_size = 0;
+		uint64_t image_mtime = 0;
+		std::chrono::steady_clock::time_point probe_time;
+		int err_code = 0;
+		std::vector<FAT_image_t> disks;
+		std::vector<MBR_t> mbrs;
+		std::vector<partition_info_t> partition_info;
+	};
+	static constexpr size_t max_probes = 8;
+
+	std::mutex mux;
+	std::deque<probe_t> probes_m; // Newest first
+
+public:
+	bool restore(whole_disk_t& arch, int& err_code) {
+		const auto now = std::chrono::steady_clock::now();
+		const auto ttl = std::chrono::milliseconds(plugin_config.probe_cache_ttl_ms);
+		const auto mtime = get_file_mtime(arch.hArchFile);
+		std::lock_guard<std::mutex> lock(mux);
+		std::erase_if(probes_m, [&](const probe_t& probe) { return now - probe.probe_time > ttl; });
+		for (const auto& probe : probes_m) {
+			if (probe.archname != arch.archname || probe.image_size != arch.image_file_size ||
+				probe.image_mtime != mtime)
+				continue;
+			try {
+				arch.disks = probe.disks;
+				arch.mbrs = probe.mbrs;
+				arch.partition_info = probe.partition_info;
+			}
+			catch (std::bad_alloc&) {
+				return false; // Probe again, arch is reset by it
+			}
+			for (auto& disk : arch.disks) {
+				disk.whole_disk_ptr = &arch;
+			}
+			err_code = probe.err_code;
+			return true;
+		}
+		return false;
+	}
+
+	void save(const whole_disk_t& arch, int err_code) {
+		try {
+			probe_t probe;
+			probe.archname = arch.archname;
+			probe.image_size = arch.image_file_size;
+			probe.image_mtime = get_file_mtime(arch.hArchFile);
+			probe.probe_time = std::chrono::steady_clock::now();
+			probe.err_code = err_code;
+			probe.disks = arch.disks;
+			probe.mbrs = arch.mbrs;
+			probe.partition_info = arch.partition_info;
+			std::lock_guard<std::mutex> lock(mux);
+			std::erase_if(probes_m, [&](const probe_t& old) { return old.archname == probe.archname; });
+			probes_m.push_front(std::move(probe));
+			if (probes_m.size() > max_probes)
+				probes_m.pop_back();
+		}
+		catch (std::bad_alloc&) {
+			// Cache is optional
+		}
+	}
+
+	void forget(const char* archname) {
+		std::lock_guard<std::mutex> lock(mux);
+		std::erase_if(probes_m, [&](const probe_t& probe) { return std::strcmp(probe.archname.data(), archname) == 0; });
+	}
+};
+
+static probe_cache_t probe_cache;
+
+int whole_disk_t::probe_volumes(work_stealing_pool_t* pool) {
+	if (plugin_config.probe_cache_ttl_ms == 0)
+		return process_volumes(pool);
+	int err_code = 0;
+	if (probe_cache.restore(*this, err_code)) {
+		plugin_config.log_print("Info# Using the recent probe of the image, result: %d", err_code);
+		return err_code;
+	}
+	err_code = process_volumes(pool);
+	probe_cache.save(*this, err_code);
+	return err_code;
+}
+
+void whole_disk_t::forget_probe(const char* archname) {
+	probe_cache.forget(archname);
+}
+
+int whole_disk_t::process_volumes(work_stealing_pool_t* pool) {
 	auto err_code = disks[0].process_bootsector(true);
 
 	if (err_code != 0) {
@@ -1347,22 +2179,31 @@ int whole_disk_t::process_volumes() {
 			if (!err_code) {
 				// Single partition -- treat as a non-partitioned disk for viewing
 				disks[0].set_boot_sector_offset(partition_info[0].first_sector * sector_size);
-				plugin_config.log_print_dbg("Info# Processing partition 0, offset: 0x%010X", disks[0].get_boot_sector_offset());
-				first_err_code = disks[0].process_bootsector(true);
+				plugin_config.log_print_dbg("Info# Processing partition 0, offset: 0x%010llX",
+					static_cast<unsigned long long>(disks[0].get_boot_sector_offset()));
+				for (size_t i = 1; i < partition_info.size(); ++i) {
+					disks.emplace_back(this);
+					disks.back().set_boot_sector_offset(partition_info[i].first_sector * sector_size);
+				}
+				// Filled in parallel, reported in the partitions order
+				std::vector<int> partition_err_codes(disks.size());
+				run_for_each(may_show_dialogs() ? nullptr : pool, disks.size(), [this, &partition_err_codes](size_t i) {
+					partition_err_codes[i] = disks[i].process_bootsector(true);
+					});
+
+				first_err_code = partition_err_codes[0];
 				if(first_err_code != 0)
 					plugin_config.log_print_dbg("Warning# Error processing partition 0: %d", first_err_code);
 				else
 					plugin_config.log_print("Info# Processed partition 0");
 
-				for (size_t i = 1; i < partition_info.size(); ++i) {
-					disks.emplace_back(this);
-					disks.back().set_boot_sector_offset(partition_info[i].first_sector * sector_size);
-					err_code = disks.back().process_bootsector(true);
+				for (size_t i = 1; i < disks.size(); ++i) {
+					err_code = partition_err_codes[i];
 					if (err_code != 0)
-						plugin_config.log_print_dbg("Warning# Error processing partition %zd: %d", i, first_err_code);
+						plugin_config.log_print_dbg("Warning# Error processing partition %zd: %d", i, err_code);
 					else
-						plugin_config.log_print("Info# Processed partition %zd, offset: 0x%010X", i,
-							disks.back().get_boot_sector_offset());
+						plugin_config.log_print("Info# Processed partition %zd, offset: 0x%010llX", i,
+							static_cast<unsigned long long>(disks[i].get_boot_sector_offset()));
 				}
 				if (disks.empty() || (first_err_code != 0 && disks.size() == 1)) {
 					err_code = E_UNKNOWN_FORMAT;
@@ -1386,7 +2227,8 @@ int whole_disk_t::process_volumes() {
 				if (err_code != 0)
 					plugin_config.log_print_dbg("Warning# Error searching for boot sector: %d", err_code);
 				else
-					plugin_config.log_print("Info# Found boot sector at: 0x%010X", disks[0].boot_sector_offset);
+					plugin_config.log_print("Info# Found boot sector at: 0x%010llX",
+						static_cast<unsigned long long>(disks[0].boot_sector_offset));
 			}
 		}
 	}
@@ -1431,16 +2273,15 @@ extern "C" {
 		ArchiveData->CmtState = 0;
 
 
-		size_t image_file_size = get_file_size(ArchiveData->ArcName);
-		auto hArchFile = open_file_shared_read(ArchiveData->ArcName);
-		if (hArchFile == file_open_error_v)
+		auto image = acquire_image_file(ArchiveData->ArcName, false);
+		if (!image)
 		{
 			ArchiveData->OpenResult = E_EOPEN;
 			return nullptr;
 		}
 		try {
-			arch = std::make_unique<whole_disk_t>(ArchiveData->ArcName, image_file_size,
-				hArchFile, ArchiveData->OpenMode);
+			arch = std::make_unique<whole_disk_t>(ArchiveData->ArcName, std::move(image),
+				ArchiveData->OpenMode);
 		}
 		catch (std::bad_alloc&) {
 			ArchiveData->OpenResult = E_NO_MEMORY;
@@ -1449,21 +2290,79 @@ extern "C" {
 
 		arch->oldHandler = _set_invalid_parameter_handler(myInvalidParameterHandler);
 
-		auto err_code = arch->process_volumes();
+		if (plugin_config.use_memory_mapping) {
+			arch->image_view = arch->image->get_read_only_view(); // nullptr if not possible -- then regular reads are used
+			plugin_config.log_print("Info# Image memory mapping: %s", arch->image_view ? "used" : "failed");
+		}
+
+		// Partitions are processed in parallel, results are then accounted in the disks order as before
+		auto pool = make_open_pool();
+		auto err_code = arch->probe_volumes(pool.get());
 
 		int loaded_FATs = 0;
 		size_t loaded_catalogs = 0;
 		if (err_code == 0) {
-			for (size_t i = 0; i < arch->disks.size(); ++i) {
-				if (!arch->disks[i].is_known_FS_type())
+			auto& disks = arch->disks;
+			std::vector<int> FAT_err_codes(disks.size(), 0);
+			run_for_each(pool.get(), disks.size(), [&disks, &FAT_err_codes](size_t i) {
+				if (disks[i].is_known_FS_type())
+					FAT_err_codes[i] = disks[i].load_FAT();
+				});
+			// After the first loaded FAT, catalogs are read even if the FAT loading failed
+			std::vector<char> to_list(disks.size(), false);
+			for (size_t i = 0, loaded = 0; i < disks.size(); ++i) {
+				if (!disks[i].is_known_FS_type() || (FAT_err_codes[i] != 0 && loaded == 0))
 					continue;
-				err_code = arch->disks[i].load_FAT();
+				to_list[i] = true;
+				disks[i].lazy_listing_m = plugin_config.lazy_listing;
+				++loaded;
+			}
+			// Unchanged image is listed from the cache, without reading the directories
+			std::vector<uint64_t> fs_hashes(plugin_config.listing_cache ? disks.size() : 0);
+			bool from_cache = false;
+			if (plugin_config.listing_cache) {
+				run_for_each(pool.get(), disks.size(), [&disks, &fs_hashes](size_t i) {
+					fs_hashes[i] = disks[i].get_fs_hash();
+					});
+				from_cache = arch->list_from_cache(to_list, fs_hashes);
+			}
+			std::vector<dir_listing_t> listings;
+			std::vector<int> list_err_codes(disks.size(), 0);
+			if (!from_cache) {
+				try {
+					listings.resize(disks.size());
+				}
+				catch (std::bad_alloc&) {
+					ArchiveData->OpenResult = E_NO_MEMORY;
+					return nullptr;
+				}
+				// Each task reads the root directory and submits the subdirectories to the same pool
+				run_for_each(pool.get(), disks.size(), [&](size_t i) {
+					if (to_list[i])
+						list_err_codes[i] = disks[i].start_file_list(listings[i], pool.get());
+					});
+				if (pool) {
+					pool->wait(); // Subdirectories
+				}
+			}
+			// Lazy listing: the pool is kept to read the subdirectories ahead of the ReadHeader()
+			if (plugin_config.lazy_listing && plugin_config.lazy_listing_prefetch && !from_cache) {
+				arch->prefetcher.pool = std::move(pool);
+			}
+
+			bool all_listed = true; // Only complete listings are cached
+
+			for (size_t i = 0; i < disks.size(); ++i) {
+				if (!disks[i].is_known_FS_type())
+					continue;
+				err_code = FAT_err_codes[i];
 				if (err_code != 0 && loaded_FATs == 0) { // Saving the first error
 					ArchiveData->OpenResult = err_code;
 				}
 				else {
 					++loaded_FATs; //-V127
-					err_code = arch->disks[i].load_file_list_recursively(minimal_fixed_string_t<MAX_PATH>{}, 0, 0);
+					err_code = from_cache ? 0 : disks[i].finish_file_list(listings[i], list_err_codes[i]);
+					all_listed = all_listed && err_code == 0;
 					if (err_code != 0 && loaded_catalogs == 0) { // Saving the first error
 
 						ArchiveData->OpenResult = err_code;
@@ -1473,6 +2372,10 @@ extern "C" {
 					}
 				}
 			}
+			// Lazy listing is not complete yet
+			if (plugin_config.listing_cache && !plugin_config.lazy_listing && !from_cache && all_listed && loaded_catalogs > 0) {
+				arch->save_to_cache(to_list, fs_hashes);
+			}
 		}
 
 		plugin_config.log_print("Info# Loaded FATs %d, of them -- catalogs: %zd", loaded_FATs, loaded_catalogs);
@@ -1502,10 +2405,13 @@ extern "C" {
 		prev_current_disk.set_processed_for_empty();
 		// get_disk_prefix
 		auto& current_disk = hArcData->disks[hArcData->disc_counter];
+		if (current_disk.is_known_FS_type() && current_disk.counter < current_disk.arc_dir_entries.size()) {
+			current_disk.expand_pending_dir(current_disk.counter); // Lazy listing -- its entries are listed later
+		}
 		strcpy(HeaderData->ArcName, hArcData->archname.data());
 		if (hArcData->disks.size() == 1) {
 			if (!current_disk.arc_dir_entries.empty())
-				strcpy(HeaderData->FileName, current_disk.arc_dir_entries[current_disk.counter].PathName.data());
+				strcpy(HeaderData->FileName, current_disk.get_entry_path(current_disk.counter).data());
 			else
 				return E_END_ARCHIVE;
 		}
@@ -1517,7 +2423,7 @@ extern "C" {
 				disk_name.push_back("_Unknown");
 			}
 			else if (!hArcData->disks[hArcData->disc_counter].arc_dir_entries.empty())
-				disk_name.push_back(current_disk.arc_dir_entries[current_disk.counter].PathName);
+				disk_name.push_back(current_disk.get_entry_path(current_disk.counter));
 			strcpy(HeaderData->FileName, disk_name.data());
 		}
 		if (!hArcData->disks[hArcData->disc_counter].arc_dir_entries.empty() &&
@@ -1578,8 +2484,11 @@ extern "C" {
 			return E_ECREATE;
 
 		auto res = hArcData->disks[hArcData->disc_counter].extract_to_file(hUnpFile,
-			hArcData->disks[hArcData->disc_counter].counter - 1);
+			hArcData->disks[hArcData->disc_counter].counter - 1, dest);
 		if (res != 0) {
+			if (res == E_EABORTED) {
+				delete_file(dest); // Do not leave partially extracted file
+			}
 			return res;
 		}
 		const auto& cur_entry = hArcData->disks[hArcData->disc_counter].
@@ -1588,13 +2497,6 @@ extern "C" {
 		close_file(hUnpFile);
 		set_file_attributes_ex(dest, cur_entry.FileAttr);
 
-		if (whole_disk_t::pLocProcessData) {
-			// TODO: Second parameter is: "the number of bytes processed since the previous call to the function"...
-			auto res = whole_disk_t::pLocProcessData(dest, static_cast<int>(get_file_size(dest)));
-			if (res == 0)
-				return E_EABORTED;
-		}
-
 		if (Operation == PK_TEST) {
 			delete_file(dest);
 		}
@@ -1647,17 +2549,14 @@ extern "C" {
 	}
 #endif 
 	DLLEXPORT int STDCALL CanYouHandleThisFile(char* FileName) { // BOOL == int 
-		size_t image_file_size = get_file_size(FileName);
-		auto hArchFile = open_file_shared_read(FileName);
-		if (hArchFile == file_open_error_v)
+		auto image = acquire_image_file(FileName, false);
+		if (!image)
 		{
 			return 0;
 		}
-		// Caching results here would complicate code too much as for now
-		whole_disk_t arch{ FileName, image_file_size,
-				hArchFile, PK_OM_LIST };
+		whole_disk_t arch{ FileName, std::move(image), PK_OM_LIST };
 
-		auto err_code = arch.process_volumes();
+		auto err_code = arch.probe_volumes(); // Result is reused by the following OpenArchive()
 		int is_OK = (err_code != 0);
 		return is_OK;
 	}
@@ -1725,7 +2624,7 @@ extern "C" {
 			return E_NO_MEMORY;
 		}
 
-		auto read_bytes = read_file(srcFile, buffer.get(), srcFileSize); // Read the whole file into memory
+		auto read_bytes = read_file(srcFile, buffer.get(), static_cast<size_t>(srcFileSize)); // Read the whole file into memory
 		if (read_bytes != srcFileSize) {
 			plugin_config.log_print_dbg("Warning# in PackFiles, read_file failed, requested %d bytes, read %d.",
 				srcFileSize, read_bytes);
@@ -1746,7 +2645,12 @@ extern "C" {
 		}
 
 		close_file(srcFile);
-		f_close(&dstFile);
+		// Data could be still in the sector cache -- write errors are reported by the flush in f_close()
+		fr = f_close(&dstFile);
+		if (fr != FR_OK) {
+			plugin_config.log_print_dbg("Warning# in PackFiles, f_close failed: %d.", static_cast<int>(fr));
+			return E_EWRITE;
+		}
 
 		copy_attributes_and_datetime(src_path, target_path);
 
@@ -1799,8 +2703,9 @@ extern "C" {
 		FATFS fs;
 		char disk_number[3] = "0:";
 		FRESULT fs_result;
+		bool is_mounted = true;
 	public:
-		FatFS_mounter_t(int disk_number_in, const char* archive_name, size_t boot_sector_offset) {
+		FatFS_mounter_t(int disk_number_in, const char* archive_name, uint64_t boot_sector_offset) {
 			strncpy(fs.image_path, archive_name, MAX_PATH);
 			fs.boot_sector_offset = boot_sector_offset;
 			disk_number[0] += disk_number_in;
@@ -1810,12 +2715,19 @@ extern "C" {
 		FRESULT get_error() const { return fs_result; }
 		const char* get_disk() const { return disk_number; }
 		
-		// Unmount and stop image
-		~FatFS_mounter_t() {
+		//! Unmount and stop image. Cached writes are flushed here, so FR_DISK_ERR means the image was not fully written.
+		FRESULT unmount() {
+			if (!is_mounted)
+				return FR_OK;
+			is_mounted = false;
 			// Abstractions are mixed here, but it is dictated by the FatFS design...
 			f_mount(nullptr, disk_number, 0);
 
-			disk_deinitialize(fs.image_path);
+			return disk_deinitialize(fs.image_path) == RES_OK ? FR_OK : FR_DISK_ERR;
+		}
+
+		~FatFS_mounter_t() {
+			unmount();
 		}
 	};
 
@@ -1847,6 +2759,8 @@ extern "C" {
 		if (Flags & PK_PACK_ENCRYPT) {
 			plugin_config.log_print_dbg("Warning# Plugin does not supports encryption.");
 		}
+		// Size and time of the image would change too, but they are not reliable enough on all hosts
+		invalidate_listing_cache(plugin_config.listing_cache_dir.data(), PackedFile);
 		
 		bool savePaths = (Flags & PK_PACK_SAVE_PATHS);
 
@@ -1857,12 +2771,21 @@ extern "C" {
 			size_t file_size = nw.single_part ?
 				nw.custom_value * nw.unit_factor(nw.custom_unit) :
 				nw.total_value * nw.unit_factor(nw.total_unit);
-			auto res = create_sized_file(PackedFile, file_size); 
+			// Sparse image is zero-filled; f_mkfs() writes only the boot sector, FATs and the root directory
+			auto res = conf_copy.sparse_new_images ?
+				create_sparse_file(PackedFile, file_size) :
+				create_sized_file(PackedFile, file_size); 
 			if(!res){
 				plugin_config.log_print_dbg("Warning# Error creating new image file: %d", res);
 				return E_ECREATE; 
 			}
-			BYTE workarea[16 * FF_MAX_SS]; // I hope dynamic allocation is overkill here
+			// FAT areas are zeroed by f_mkfs() in workarea-sized writes, so the larger, the fewer writes
+			constexpr size_t workarea_size = 1024 * 1024;
+			std::unique_ptr<BYTE[]> workarea{ new(std::nothrow) BYTE[workarea_size] };
+			if (!workarea) {
+				plugin_config.log_print_dbg("Warning# Not enough memory for the f_mkfs() work area.");
+				return E_NO_MEMORY;
+			}
 			if (nw.single_part) {
 				MKFS_PARM opt;
 				opt.n_fat = 2; // TODO: make it configurable
@@ -1873,8 +2796,9 @@ extern "C" {
 
 				char dsk[] = "0:";
 				dsk[0] += floppy_vol_index; 
-				FRESULT fs_result = f_mkfs(dsk, &opt, workarea, sizeof(workarea), PackedFile);
-				disk_deinitialize(PackedFile);
+				FRESULT fs_result = f_mkfs(dsk, &opt, workarea.get(), workarea_size, PackedFile);
+				if (disk_deinitialize(PackedFile) != RES_OK && fs_result == FR_OK)
+					fs_result = FR_DISK_ERR; // Cached writes were not flushed
 				if( fs_result != FR_OK) {					
 					plugin_config.log_print_dbg("Warning# Error creating new image file: %d", static_cast<int>(fs_result));
 					return E_ECREATE;
@@ -1895,8 +2819,9 @@ extern "C" {
 					plist[i] = static_cast<LBA_t>(cur_size);
 				}
 
-				FRESULT fs_result = f_fdisk(0, plist, workarea, PackedFile);
-				disk_deinitialize(PackedFile);
+				FRESULT fs_result = f_fdisk(0, plist, workarea.get(), PackedFile);
+				if (disk_deinitialize(PackedFile) != RES_OK && fs_result == FR_OK)
+					fs_result = FR_DISK_ERR; // Cached writes were not flushed
 				if (fs_result != FR_OK) {
 					plugin_config.log_print_dbg("Warning# Error partitioning new image file (f_fdisk()): %d", static_cast<int>(fs_result));
 					return E_ECREATE;
@@ -1917,8 +2842,9 @@ extern "C" {
 					char dsk[] = "0:";
 					dsk[0] += i;
 					// TODO: add more detailed error diagnostics in f_mkfs(). 
-					FRESULT fs_result = f_mkfs(dsk, &opt, workarea, sizeof(workarea), PackedFile);
-					disk_deinitialize(PackedFile);
+					FRESULT fs_result = f_mkfs(dsk, &opt, workarea.get(), workarea_size, PackedFile);
+					if (disk_deinitialize(PackedFile) != RES_OK && fs_result == FR_OK)
+						fs_result = FR_DISK_ERR; // Cached writes were not flushed
 					if (fs_result != FR_OK) {
 						plugin_config.log_print_dbg("Warning# Error creating new image file: %d, partition No %d.", 
 							static_cast<int>(fs_result), i);
@@ -1941,28 +2867,28 @@ extern "C" {
 		}
 
 		bool have_many_partitions;
-		size_t boot_sector_offset = 0;
+		uint64_t boot_sector_offset = 0;
+		// Kept open till the end -- FatFS mount reuses it instead of reopening the image
+		auto image = acquire_image_file(PackedFile, true);
+		if (!image)
 		{
-			size_t image_file_size = get_file_size(PackedFile);
+			return E_EREAD;
+		}
+		{
+			// FatFS is built with 32-bit LBA (FF_LBA64 requires exFAT), so only first 2Tb are addressable.
+			// It covers any MBR partition and any FAT32 volume with 512-byte sectors.
+			if (image->size / FF_MIN_SS > 0xFFFF'FFFFull) {
 #ifdef FLTK_ENABLED_EXPERIMENTAL
-			if (image_file_size >= 2u*1024u*1024u*1024u){
 				if (plugin_config.allow_dialogs) {
-					fl_alert("Images larger than 2Tb are supported only partially, and working with them is unstable.");
+					fl_alert("Only the first 2Tb of the image are accessible when modifying it.");
 				}
-				plugin_config.log_print_dbg("Warning# Images larger than 2Tb are supported only partially, and working with them is unstable.");
-			}
 #endif 
-			auto hArchFile = open_file_read_shared_write(PackedFile);
-			if (hArchFile == file_open_error_v)
-			{
-				return E_EREAD;
+				plugin_config.log_print_dbg("Warning# Only the first 2Tb of the image are accessible when modifying it.");
 			}
+			whole_disk_t arch{ PackedFile, image, PK_OM_LIST };
 
-			// Caching results here would complicate code too much as for now
-			whole_disk_t arch{ PackedFile, image_file_size,
-					hArchFile, PK_OM_LIST };
-
-			auto err_code = arch.process_volumes();
+			auto err_code = arch.probe_volumes();
+			whole_disk_t::forget_probe(PackedFile); // Image would be modified
 			if (err_code != 0)
 			{
 				return E_EREAD;
@@ -2042,7 +2968,7 @@ extern "C" {
 				auto res = copy_from_host_to_image(srcFullPath.data(), targetPath.data());
 				if (res != 0)
 					return res;
-				if (Flags & PK_PACK_MOVE_FILES) {
+				if (Flags & PK_PACK_MOVE_FILES) { // Already flushed to the image by f_close()
 					auto res2 = delete_file(srcFullPath.data());
 					if (!res2)
 						return E_NOT_SUPPORTED; // Which error would be best here?
@@ -2062,6 +2988,10 @@ extern "C" {
 			}
 		}
 
+		if (fatfs_RAII.unmount() != FR_OK) {
+			plugin_config.log_print_dbg("Warning# in PackFiles, flushing the image failed.");
+			return E_EWRITE;
+		}
 		return 0;
 	}
 	
@@ -2071,24 +3001,23 @@ extern "C" {
 		plugin_config.log_print_dbg("Info# DeleteFiles() Called with: PackedFile=\'%s\'; DeleteList=\'%s\'",
 			PackedFile ? PackedFile : "NULL", DeleteList ? DeleteList : "NULL"
 		);
+		invalidate_listing_cache(plugin_config.listing_cache_dir.data(), PackedFile);
 
 		int logical_drive_number = floppy_vol_index;
 
 		bool have_many_partitions;
-		size_t boot_sector_offset = 0;
+		uint64_t boot_sector_offset = 0;
+		// Kept open till the end -- FatFS mount reuses it instead of reopening the image
+		auto image = acquire_image_file(PackedFile, true);
+		if (!image)
 		{
-			size_t image_file_size = get_file_size(PackedFile);
-			auto hArchFile = open_file_read_shared_write(PackedFile);
-			if (hArchFile == file_open_error_v)
-			{
-				return E_EREAD;
-			}
-
-			// Caching results here would complicate code too much as for now
-			whole_disk_t arch{ PackedFile, image_file_size,
-					hArchFile, PK_OM_LIST };
+			return E_EREAD;
+		}
+		{
+			whole_disk_t arch{ PackedFile, image, PK_OM_LIST };
 
-			auto err_code = arch.process_volumes();
+			auto err_code = arch.probe_volumes();
+			whole_disk_t::forget_probe(PackedFile); // Image would be modified
 			if (err_code != 0)
 			{
 				return E_EREAD;
@@ -2242,6 +3171,10 @@ extern "C" {
 			current += strlen(current) + 1; // move onto next file
 		}
 
+		if (fatfs_RAII.unmount() != FR_OK) {
+			plugin_config.log_print_dbg("Warning# in DeleteFiles, flushing the image failed.");
+			return E_EWRITE;
+		}
 		return anyFailed ? E_EWRITE : 0;
 
 	}
@@ -53,6 +53,9 @@ typedef uint16_t		WORD;	/* 16-bit unsigned */
 typedef uint32_t		DWORD;	/* 32-bit unsigned */
 typedef uint64_t		QWORD;	/* 64-bit unsigned */
 typedef WORD			WCHAR;	/* UTF-16 code unit */
+#ifndef MAX_PATH
+#define MAX_PATH 260	/* For the image_path extension of the FATFS */
+#endif
 
 #else  	/* Earlier than C99 */
 #define FF_INTDEF 1
@@ -174,7 +177,7 @@ typedef struct {
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
 /*-------------------------------------*/
 	TCHAR	image_path[MAX_PATH]; /* Extension for working with the disk images */
-	size_t  boot_sector_offset;   /* Extension for images which does not start from the file beggining */
+	QWORD   boot_sector_offset;   /* Extension for images which does not start from the file beggining */
 } FATFS;
 
 
@@ -368,6 +371,7 @@ DWORD get_fattime (void);	/* Get current time */
 #if FF_USE_LFN >= 1
 WCHAR ff_oem2uni (WCHAR oem, WORD cp);	/* OEM code to Unicode conversion */
 WCHAR ff_uni2oem (DWORD uni, WORD cp);	/* Unicode to OEM code conversion */
+int ff_uni2oem_table (DWORD uni, WCHAR* oem);	/* Table-driven ff_uni2oem() for SBCS code pages, 0: no table (defined in codepage.cpp) */
 DWORD ff_wtoupper (DWORD uni);			/* Unicode upper-case conversion */
 #endif
 
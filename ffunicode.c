@@ -15233,8 +15233,10 @@ WCHAR ff_uni2oem (	/* Returns OEM code character, zero on error */
 
 	} else {			/* Non-ASCII */
 		if (uni < 0x10000 && cp == FF_CODE_PAGE) {	/* Is it in BMP and valid code page? */
-			for (c = 0; c < 0x80 && uni != p[c]; c++) ;
-			c = (c + 0x80) & 0xFF;
+			if (!ff_uni2oem_table(uni, &c)) {	/* No lookup table -- linear search */
+				for (c = 0; c < 0x80 && uni != p[c]; c++) ;
+				c = (c + 0x80) & 0xFF;
+			}
 		}
 	}
 
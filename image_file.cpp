@@ -0,0 +1,63 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "image_file.h"
+
+#include <map>
+#include <string>
+#include <mutex>
+
+namespace {
+	std::mutex image_files_mux;
+	//! Registry does not own the images -- they are closed when the last user releases them.
+	std::map<std::string, std::weak_ptr<image_file_t>> image_files;
+}
+
+const uint8_t* image_file_t::get_read_only_view() {
+	if (writable)
+		return nullptr; // FatFS writes would not be coherent with the view on all platforms
+	std::call_once(mapping_flag, [this]() {
+		map_file_read_only(handle, size, mapping);
+	});
+	return mapping.data;
+}
+
+image_file_ptr_t acquire_image_file(const char* path, bool writable) {
+	std::lock_guard<std::mutex> lock(image_files_mux);
+
+	auto itr = image_files.find(path);
+	if (itr != image_files.end()) {
+		auto img = itr->second.lock();
+		if (img && (img->writable || !writable)) {
+			return img;
+		}
+	}
+
+	auto img = std::make_shared<image_file_t>();
+	img->path.push_back(path);
+	img->writable = writable;
+	img->handle = writable ? open_file_read_write(path) : open_file_shared_read(path);
+	if (img->handle == file_open_error_v) {
+		return {};
+	}
+	img->size = get_file_size(img->handle);
+	if (img->size == static_cast<uint64_t>(-1)) {
+		return {};
+	}
+
+	// Drop expired entries, so the registry does not grow with every image ever opened
+	for (auto it = image_files.begin(); it != image_files.end(); ) {
+		if (it->second.expired())
+			it = image_files.erase(it);
+		else
+			++it;
+	}
+	image_files[path] = img;
+	return img;
+}
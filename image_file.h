@@ -0,0 +1,52 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef IMAGE_FILE_H_INCLUDED
+#define IMAGE_FILE_H_INCLUDED
+
+#include "minimal_fixed_string.h"
+#include "sysio_winapi.h"
+
+#include <memory>
+#include <mutex>
+
+//! Opened image file, shared between the layout probing (whole_disk_t) and the FatFS disk glue (diskio.cpp).
+//! PackFiles()/DeleteFiles() probe the image and then mount it -- both use the same handle and the same size query.
+struct image_file_t {
+	minimal_fixed_string_t<MAX_PATH> path;
+	file_handle_t handle = file_open_error_v;
+	uint64_t size = 0;      // Queried once, on open. Images are never resized while opened.
+	bool writable = false;
+
+	image_file_t() = default;
+	image_file_t(const image_file_t&) = delete;
+	image_file_t& operator=(const image_file_t&) = delete;
+	~image_file_t() {
+		unmap_file(mapping);
+		if (handle != file_open_error_v)
+			close_file(handle);
+	}
+
+	//! Maps the image on the first call. Returns nullptr for the writable images or if mapping failed.
+	const uint8_t* get_read_only_view();
+
+private:
+	file_mapping_t mapping;
+	std::once_flag mapping_flag;
+};
+
+using image_file_ptr_t = std::shared_ptr<image_file_t>;
+
+//! Returns already opened image with the same path, if any, or opens it.
+//! Read-only handle is not reused when writable one is requested -- new handle is opened and registered instead,
+//! current users of the old one keep it till release.
+//! Returns empty pointer on failure.
+image_file_ptr_t acquire_image_file(const char* path, bool writable);
+
+#endif
@@ -0,0 +1,243 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "listing_cache.h"
+#include "sysio_winapi.h"
+#include "minimal_fixed_string.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace {
+	constexpr char cache_magic[8] = { 'F', 'A', 'T', 'I', 'M', 'G', 'L', 'C' };
+	constexpr uint32_t cache_version = 1;
+
+	struct file_header_t {
+		char magic[8];
+		uint32_t version;
+		uint32_t entry_size;
+		uint64_t image_size;
+		uint64_t image_mtime;
+		uint64_t payload_hash; // Everything after the header
+		uint32_t path_size;
+		uint32_t volumes_n;
+	};
+
+	struct volume_header_t {
+		uint64_t fs_hash;
+		uint32_t flags;
+		uint32_t entries_n;
+		uint32_t names_size;
+		uint32_t reserved;
+	};
+
+	constexpr char cache_file_prefix[] = "fatimg_";
+	constexpr char cache_file_suffix[] = ".lst";
+
+	//! Configured cache directory or the system temporary one; dir should have MAX_PATH bytes. nullptr on error.
+	const char* get_cache_dir(const char* cache_dir, char* dir) {
+		if (cache_dir != nullptr && *cache_dir != '\0')
+			return cache_dir;
+		return get_temp_dir(dir) ? dir : nullptr;
+	}
+
+	//! Path to the cache file of the image, empty on error
+	minimal_fixed_string_t<MAX_PATH> get_cache_file_path(const char* cache_dir, const char* image_path) {
+		minimal_fixed_string_t<MAX_PATH> res;
+		char dir[MAX_PATH];
+		cache_dir = get_cache_dir(cache_dir, dir);
+		if (cache_dir == nullptr)
+			return res;
+		char name[32];
+		snprintf(name, sizeof(name), "%s%016llx%s", cache_file_prefix,
+			static_cast<unsigned long long>(hash_bytes(image_path, strlen(image_path))), cache_file_suffix);
+		size_t dir_len = strlen(cache_dir);
+		if (dir_len + 1 + strlen(name) >= MAX_PATH)
+			return res;
+		res.push_back(cache_dir);
+		if (dir_len > 0 && cache_dir[dir_len - 1] != '\\' && cache_dir[dir_len - 1] != '/')
+			res.push_back(get_path_separator());
+		res.push_back(name);
+		return res;
+	}
+
+	//! Bounds-checked sequential reader of the loaded file
+	struct byte_reader_t {
+		const uint8_t* pos;
+		const uint8_t* end;
+
+		bool read(void* dst, size_t size) {
+			if (static_cast<size_t>(end - pos) < size)
+				return false;
+			std::memcpy(dst, pos, size);
+			pos += size;
+			return true;
+		}
+	};
+
+	//! Nothing evicts the cache files of the images which are not opened anymore, so their number is limited
+	void trim_listing_cache(const char* cache_dir, size_t max_files) {
+		char dir[MAX_PATH];
+		cache_dir = get_cache_dir(cache_dir, dir);
+		std::vector<dir_file_info_t> files;
+		if (cache_dir == nullptr || !list_dir_files(cache_dir, cache_file_prefix, cache_file_suffix, files) ||
+			files.size() <= max_files)
+			return;
+		const auto excess = static_cast<std::ptrdiff_t>(files.size() - max_files);
+		std::nth_element(files.begin(), files.begin() + excess - 1, files.end(),
+			[](const dir_file_info_t& a, const dir_file_info_t& b) { return a.mtime < b.mtime; });
+		for (auto itr = files.begin(); itr != files.begin() + excess; ++itr) {
+			minimal_fixed_string_t<MAX_PATH> path{ cache_dir };
+			const size_t dir_len = path.size();
+			if (dir_len > 0 && cache_dir[dir_len - 1] != '\\' && cache_dir[dir_len - 1] != '/')
+				path.push_back(get_path_separator());
+			path.push_back(itr->name.c_str());
+			delete_file(path.data());
+		}
+	}
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+	// Multiply-xorshift over the 64-bit words, FNV-1a for the tail
+	constexpr uint64_t word_mul = 0x9E3779B97F4A7C15ull;
+	constexpr uint64_t fnv_prime = 0x100000001B3ull;
+	uint64_t h = seed ^ 0xCBF29CE484222325ull ^ (static_cast<uint64_t>(size) * word_mul);
+	auto ptr = static_cast<const uint8_t*>(data);
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), ptr += sizeof(uint64_t)) {
+		uint64_t word;
+		std::memcpy(&word, ptr, sizeof(word));
+		h = (h ^ word) * word_mul;
+		h ^= h >> 32;
+	}
+	for (; size > 0; --size, ++ptr) {
+		h = (h ^ *ptr) * fnv_prime;
+	}
+	h ^= h >> 29;
+	return h;
+}
+
+bool load_listing_cache(const char* cache_dir, const cached_image_id_t& image, size_t entry_size,
+	std::vector<cached_volume_t>& volumes) {
+	auto cache_path = get_cache_file_path(cache_dir, image.path);
+	if (cache_path.is_empty())
+		return false;
+	auto hnd = open_file_shared_read(cache_path.data());
+	if (hnd == file_open_error_v)
+		return false;
+	std::unique_ptr<uint8_t[]> buff;
+	uint64_t file_size = get_file_size(hnd);
+	size_t read = 0;
+	if (file_size >= sizeof(file_header_t) && file_size <= SIZE_MAX) {
+		buff.reset(new(std::nothrow) uint8_t[static_cast<size_t>(file_size)]);
+		if (buff)
+			read = read_file_at(hnd, buff.get(), static_cast<size_t>(file_size), 0);
+	}
+	close_file(hnd);
+	if (!buff || read != file_size)
+		return false;
+
+	file_header_t header;
+	std::memcpy(&header, buff.get(), sizeof(header));
+	const size_t path_size = strlen(image.path);
+	if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version ||
+		header.entry_size != entry_size || header.image_size != image.size || header.image_mtime != image.mtime ||
+		header.path_size != path_size)
+		return false;
+	byte_reader_t reader{ buff.get() + sizeof(header), buff.get() + read };
+	if (hash_bytes(reader.pos, reader.end - reader.pos) != header.payload_hash)
+		return false;
+	if (static_cast<size_t>(reader.end - reader.pos) < path_size || 
+		std::memcmp(reader.pos, image.path, path_size) != 0) // Hash collision of the paths
+		return false;
+	reader.pos += path_size;
+
+	if (header.volumes_n > (reader.end - reader.pos) / sizeof(volume_header_t))
+		return false;
+	try {
+		volumes.clear();
+		volumes.resize(header.volumes_n);
+		for (auto& volume : volumes) {
+			volume_header_t volume_header;
+			if (!reader.read(&volume_header, sizeof(volume_header)) ||
+				volume_header.entries_n > (reader.end - reader.pos) / entry_size)
+				return false;
+			volume.fs_hash = volume_header.fs_hash;
+			volume.flags = volume_header.flags;
+			volume.entries_n = volume_header.entries_n;
+			volume.entries.resize(volume_header.entries_n * entry_size);
+			if (!reader.read(volume.entries.data(), volume.entries.size()))
+				return false;
+			if (volume_header.names_size > static_cast<size_t>(reader.end - reader.pos))
+				return false;
+			volume.names.resize(volume_header.names_size);
+			if (!reader.read(volume.names.data(), volume.names.size()))
+				return false;
+		}
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+	return reader.pos == reader.end;
+}
+
+bool save_listing_cache(const char* cache_dir, const cached_image_id_t& image, size_t entry_size,
+	const std::vector<cached_volume_t>& volumes, size_t max_files) {
+	auto cache_path = get_cache_file_path(cache_dir, image.path);
+	if (cache_path.is_empty())
+		return false;
+	std::vector<uint8_t> buff;
+	try {
+		auto append = [&buff](const void* data, size_t size) {
+			auto ptr = static_cast<const uint8_t*>(data);
+			buff.insert(buff.end(), ptr, ptr + size);
+		};
+		file_header_t header{};
+		std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+		header.version = cache_version;
+		header.entry_size = static_cast<uint32_t>(entry_size);
+		header.image_size = image.size;
+		header.image_mtime = image.mtime;
+		header.path_size = static_cast<uint32_t>(strlen(image.path));
+		header.volumes_n = static_cast<uint32_t>(volumes.size());
+		append(&header, sizeof(header));
+		append(image.path, header.path_size);
+		for (const auto& volume : volumes) {
+			volume_header_t volume_header{ volume.fs_hash, volume.flags, volume.entries_n,
+				static_cast<uint32_t>(volume.names.size()), 0 };
+			append(&volume_header, sizeof(volume_header));
+			append(volume.entries.data(), volume.entries.size());
+			append(volume.names.data(), volume.names.size());
+		}
+		header.payload_hash = hash_bytes(buff.data() + sizeof(header), buff.size() - sizeof(header));
+		std::memcpy(buff.data(), &header, sizeof(header));
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+
+	auto hnd = open_file_overwrite(cache_path.data());
+	if (hnd == file_open_error_v)
+		return false;
+	bool ok = write_file(hnd, buff.data(), buff.size()) == buff.size();
+	close_file(hnd);
+	if (!ok) // Partial file would be rejected by the hash anyway
+		delete_file(cache_path.data());
+	if (max_files != 0)
+		trim_listing_cache(cache_dir, max_files);
+	return ok;
+}
+
+void invalidate_listing_cache(const char* cache_dir, const char* image_path) {
+	auto cache_path = get_cache_file_path(cache_dir, image_path);
+	if (!cache_path.is_empty() && file_exists(cache_path.data()))
+		delete_file(cache_path.data());
+}
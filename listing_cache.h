@@ -0,0 +1,50 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef LISTING_CACHE_H_INCLUDED
+#define LISTING_CACHE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! On-disk cache of the image listings, so reopening the unchanged image does not read its directory trees again.
+//! One file per image in the cache directory, named by the hash of the image path. The file is valid for the
+//! same path, size and modification time of the image; each volume also carries the hash of its boot sector
+//! and FAT (fs_hash), checked by the caller. Damaged or stale files are ignored and then overwritten.
+//! Entries are stored as raw bytes -- their layout is the caller's business, only the entry size is checked.
+
+struct cached_volume_t {
+	uint64_t fs_hash = 0;
+	uint32_t flags = 0;
+	uint32_t entries_n = 0;
+	std::vector<uint8_t> entries; // entries_n * entry_size bytes
+	std::vector<char> names;
+};
+
+struct cached_image_id_t {
+	const char* path = nullptr;
+	uint64_t size = 0;
+	uint64_t mtime = 0;
+};
+
+//! Whole cache file is read by a single read. Returns false if there is no valid cache for the image.
+bool load_listing_cache(const char* cache_dir, const cached_image_id_t& image, size_t entry_size,
+	std::vector<cached_volume_t>& volumes);
+//! Then, if there are more than max_files cache files in the cache_dir, the least recently written are removed;
+//! 0 -- no limit.
+bool save_listing_cache(const char* cache_dir, const cached_image_id_t& image, size_t entry_size,
+	const std::vector<cached_volume_t>& volumes, size_t max_files);
+//! Removes the cache of the image -- should be called when the image is modified
+void invalidate_listing_cache(const char* cache_dir, const char* image_path);
+
+//! Fast non-cryptographic hash, for the fs_hash and the cache file integrity check
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+#endif
@@ -14,6 +14,10 @@
 #include <array>
 #include <cstring>
 
+#ifndef _WIN32
+#include "sysio_winapi.h" // strcpy_s(), strnlen_s()
+#endif 
+
 template<size_t N>
 class minimal_fixed_string_t {
 	std::array<char, N> data_m = { '\0' }; // Should always be a C-string -- with '\0'
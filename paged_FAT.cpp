@@ -0,0 +1,84 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "paged_FAT.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+paged_FAT_t::paged_FAT_t(file_handle_t handle, uint64_t FAT_offset, size_t FAT_size, size_t max_pages) :
+	handle_m(handle), FAT_offset_m(FAT_offset), FAT_size_m(FAT_size), max_pages_m(std::max<size_t>(max_pages, 1))
+{
+	pages_m.reserve(max_pages_m);
+}
+
+const uint8_t* paged_FAT_t::get_page(size_t page_idx) {
+	auto itr = pages_m.find(page_idx);
+	if (itr != pages_m.end()) {
+		lru_m.splice(lru_m.begin(), lru_m, itr->second.lru_pos);
+		return itr->second.data.get();
+	}
+
+	std::unique_ptr<uint8_t[]> data;
+	if (pages_m.size() >= max_pages_m) { // Reuse the buffer of the least recently used page
+		size_t victim = lru_m.back();
+		lru_m.pop_back();
+		auto victim_itr = pages_m.find(victim);
+		data = std::move(victim_itr->second.data);
+		pages_m.erase(victim_itr);
+	}
+	else {
+		data.reset(new(std::nothrow) uint8_t[page_size]);
+		if (!data)
+			return nullptr;
+	}
+
+	size_t page_start = page_idx * page_size;
+	size_t to_read = std::min(page_size, FAT_size_m - page_start);
+	auto result = read_file_at(handle_m, data.get(), to_read, FAT_offset_m + page_start);
+	if (result != to_read)
+		return nullptr;
+	++loaded_pages_m;
+
+	lru_m.push_front(page_idx);
+	auto& page = pages_m[page_idx];
+	page.data = std::move(data);
+	page.lru_pos = lru_m.begin();
+	return page.data.get();
+}
+
+bool paged_FAT_t::read(size_t pos, void* dst, size_t n) {
+	if (pos >= FAT_size_m || n > FAT_size_m - pos)
+		return false;
+	std::lock_guard<std::mutex> lock(mux);
+	auto out = static_cast<uint8_t*>(dst);
+	while (n > 0) {
+		const uint8_t* page = get_page(pos / page_size);
+		if (!page)
+			return false;
+		size_t in_page = pos % page_size;
+		size_t cur_n = std::min(n, page_size - in_page);
+		std::memcpy(out, page + in_page, cur_n);
+		out += cur_n;
+		pos += cur_n;
+		n -= cur_n;
+	}
+	return true;
+}
+
+void paged_FAT_t::prefetch(size_t first_page, size_t count) {
+	std::lock_guard<std::mutex> lock(mux);
+	size_t total_pages = (FAT_size_m + page_size - 1) / page_size;
+	size_t last_page = std::min(total_pages, first_page + std::min(count, max_pages_m));
+	for (size_t i = first_page; i < last_page; ++i) {
+		if (!get_page(i))
+			break;
+	}
+}
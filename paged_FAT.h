@@ -0,0 +1,60 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef PAGED_FAT_H_INCLUDED
+#define PAGED_FAT_H_INCLUDED
+
+#include "sysio_winapi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+//! FAT, loaded from the image by fixed-size pages on first access, with a bounded LRU set of resident pages.
+//! Used instead of reading the whole FAT in FAT_image_t::load_FAT() for the large FAT16/FAT32 volumes.
+//! FAT12 entries cross page boundaries and FAT12 is small anyway -- it is always loaded whole.
+class paged_FAT_t {
+public:
+	static constexpr size_t page_size = 64 * 1024;
+
+	paged_FAT_t(file_handle_t handle, uint64_t FAT_offset, size_t FAT_size, size_t max_pages);
+
+	size_t size() const { return FAT_size_m; }
+
+	//! Copies n bytes starting from the pos of the FAT. Returns false on I/O error or out-of-range request.
+	bool read(size_t pos, void* dst, size_t n);
+	//! Loads pages [first_page, first_page + count), limited by the resident set size
+	void prefetch(size_t first_page, size_t count);
+
+	size_t get_loaded_pages() const { return loaded_pages_m; }
+
+private:
+	struct page_t {
+		std::unique_ptr<uint8_t[]> data;
+		std::list<size_t>::iterator lru_pos;
+	};
+
+	//! Should be called with the mux locked. Returns nullptr on I/O error.
+	const uint8_t* get_page(size_t page_idx);
+
+	file_handle_t handle_m;
+	uint64_t FAT_offset_m;
+	size_t FAT_size_m;
+	size_t max_pages_m;
+	size_t loaded_pages_m = 0; // Including reloaded after eviction
+
+	std::list<size_t> lru_m;    // Front is the most recently used
+	std::unordered_map<size_t, page_t> pages_m;
+	std::mutex mux;
+};
+
+#endif
@@ -100,6 +100,7 @@ bool plugin_config_t::read_conf(const PackDefaultParamStruct* dps, bool reread)
         if (slash_idx == config_file_path.npos)
             slash_idx = 0;
         config_file_path.shrink_to(slash_idx);
+        config_file_path.push_back(get_path_separator());
         config_file_path.push_back(inifilename);
 
         plugin_interface_version_hi = dps->PluginInterfaceVersionHi;
@@ -130,6 +131,27 @@ bool plugin_config_t::read_conf(const PackDefaultParamStruct* dps, bool reread)
 
 		max_depth = get_option_from_map<decltype(max_depth)>("max_depth"s);
 		max_invalid_chars_in_dir = get_option_from_map<decltype(max_invalid_chars_in_dir)>("max_invalid_chars_in_dir"s);
+		diskio_cache_sectors = get_option_from_map<decltype(diskio_cache_sectors)>("diskio_cache_sectors"s);
+		use_memory_mapping = get_option_from_map<decltype(use_memory_mapping)>("use_memory_mapping"s);
+		paged_FAT_threshold = get_option_from_map<decltype(paged_FAT_threshold)>("paged_FAT_threshold"s);
+		paged_FAT_cache_pages = get_option_from_map<decltype(paged_FAT_cache_pages)>("paged_FAT_cache_pages"s);
+		paged_FAT_prefetch_pages = get_option_from_map<decltype(paged_FAT_prefetch_pages)>("paged_FAT_prefetch_pages"s);
+		trim_freed_clusters = get_option_from_map<decltype(trim_freed_clusters)>("trim_freed_clusters"s);
+		sparse_new_images = get_option_from_map<decltype(sparse_new_images)>("sparse_new_images"s);
+		listing_threads = get_option_from_map<decltype(listing_threads)>("listing_threads"s);
+		lazy_listing = get_option_from_map<decltype(lazy_listing)>("lazy_listing"s);
+		lazy_listing_prefetch = get_option_from_map<decltype(lazy_listing_prefetch)>("lazy_listing_prefetch"s);
+		extract_chunk_size = get_option_from_map<decltype(extract_chunk_size)>("extract_chunk_size"s);
+		extract_buffers = get_option_from_map<decltype(extract_buffers)>("extract_buffers"s);
+		zero_copy_extract = get_option_from_map<decltype(zero_copy_extract)>("zero_copy_extract"s);
+		probe_cache_ttl_ms = get_option_from_map<decltype(probe_cache_ttl_ms)>("probe_cache_ttl_ms"s);
+		listing_cache = get_option_from_map<decltype(listing_cache)>("listing_cache"s);
+		listing_cache_min_entries = get_option_from_map<decltype(listing_cache_min_entries)>("listing_cache_min_entries"s);
+		listing_cache_max_files = get_option_from_map<decltype(listing_cache_max_files)>("listing_cache_max_files"s);
+		listing_cache_dir.clear();
+		if (options_map.count("listing_cache_dir"s)) { // Empty values are not allowed, so it is absent for the default
+			listing_cache_dir.push_back(get_option_from_map<std::string>("listing_cache_dir"s).data());
+		}
 
         //=========new_arc============================================
         new_arc.single_part = get_option_from_map<decltype(new_arc.single_part)>("new_arc_single_part"s);
@@ -205,6 +227,37 @@ bool plugin_config_t::write_conf()
     fprintf(cf, "max_depth=%zu\n", max_depth);
     fprintf(cf, "# Values above the 11 efficiently disables the check. Beware of special value LLDE_OS2_EA = 0xFFFF\n");
     fprintf(cf, "max_invalid_chars_in_dir=%zu\n", max_invalid_chars_in_dir);
+    fprintf(cf, "# Sectors in the write-back cache used when modifying images, 0 -- disabled\n");
+    fprintf(cf, "diskio_cache_sectors=%zu\n", diskio_cache_sectors);
+    fprintf(cf, "use_memory_mapping=%x\n", use_memory_mapping);
+    fprintf(cf, "# FATs larger than paged_FAT_threshold bytes are loaded by 64Kb pages when used, 0 -- disabled\n");
+    fprintf(cf, "paged_FAT_threshold=%zu\n", paged_FAT_threshold);
+    fprintf(cf, "paged_FAT_cache_pages=%zu\n", paged_FAT_cache_pages);
+    fprintf(cf, "paged_FAT_prefetch_pages=%zu\n", paged_FAT_prefetch_pages);
+    fprintf(cf, "# Punch holes in the image file for the freed clusters, making it sparse\n");
+    fprintf(cf, "trim_freed_clusters=%x\n", trim_freed_clusters);
+    fprintf(cf, "sparse_new_images=%x\n", sparse_new_images);
+    fprintf(cf, "# Threads reading partitions and directory trees, 0 -- auto, 1 -- no parallel reading\n");
+    fprintf(cf, "listing_threads=%zu\n", listing_threads);
+    fprintf(cf, "# Read subdirectories only when the listing reaches them, with prefetch -- one level ahead in background\n");
+    fprintf(cf, "lazy_listing=%x\n", lazy_listing);
+    fprintf(cf, "lazy_listing_prefetch=%x\n", lazy_listing_prefetch);
+    fprintf(cf, "# Bytes read and written at once when extracting consecutive clusters of a file\n");
+    fprintf(cf, "extract_chunk_size=%zu\n", extract_chunk_size);
+    fprintf(cf, "# Buffers of the extraction: next chunks are read while the current one is written, 1 -- no overlap\n");
+    fprintf(cf, "extract_buffers=%zu\n", extract_buffers);
+    fprintf(cf, "zero_copy_extract=%x\n", zero_copy_extract);
+    fprintf(cf, "# Layout of the image is reused by the following calls during this time (ms), 0 -- disabled\n");
+    fprintf(cf, "probe_cache_ttl_ms=%zu\n", probe_cache_ttl_ms);
+    fprintf(cf, "# Listings of the images with at least listing_cache_min_entries entries are saved to listing_cache_dir\n");
+    fprintf(cf, "# (system temporary directory if absent), so unchanged images are reopened without reading the directories\n");
+    fprintf(cf, "listing_cache=%x\n", listing_cache);
+    fprintf(cf, "listing_cache_min_entries=%zu\n", listing_cache_min_entries);
+    fprintf(cf, "# At most listing_cache_max_files cache files are kept, the least recently written are removed; 0 -- no limit\n");
+    fprintf(cf, "listing_cache_max_files=%zu\n", listing_cache_max_files);
+    if (!listing_cache_dir.is_empty()) {
+        fprintf(cf, "listing_cache_dir=%s\n", listing_cache_dir.data());
+    }
 
     //=========new_arc============================================
     fprintf(cf, "\nnew_arc_single_part=%x\n", new_arc.single_part);
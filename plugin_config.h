@@ -21,8 +21,8 @@
 #define NOMINMAX
 #endif
 #include <windows.h>
-#include "sysio_winapi.h"
 #endif 
+#include "sysio_winapi.h"
 #include "wcxhead.h"
 
 
@@ -54,6 +54,26 @@ struct plugin_config_t {
 
 	size_t max_invalid_chars_in_dir = 0; // Values above 11 efficiently disable the check for invalid characters in directory names
 
+	size_t diskio_cache_sectors = 1024; // Write-back sector cache for the FatFS (image modification), 0 -- disabled
+	bool use_memory_mapping = true;      // Map the image when listing/extracting instead of reading it; falls back to reads on failure
+	                                     // Images on network shares and removable media are never mapped, see map_file_read_only()
+	size_t paged_FAT_threshold = 16 * 1024 * 1024; // Larger FAT16/32 are loaded by pages on demand, 0 -- always load whole FAT
+	size_t paged_FAT_cache_pages = 256;            // Resident FAT pages (64Kb each)
+	size_t paged_FAT_prefetch_pages = 4;           // Pages loaded at open, starting from the root directory cluster
+	bool trim_freed_clusters = false;    // Deallocate clusters freed by the FatFS in the host image file (sparse file)
+	bool sparse_new_images = true;       // Create new images as zero-filled sparse files instead of writing 0xFF to the whole image
+	size_t listing_threads = 0;          // Threads reading partitions and directory trees on open, 0 -- auto, 1 -- serial reading
+	bool lazy_listing = false;           // Read only the root directories on open, subdirectories -- when the listing reaches them
+	bool lazy_listing_prefetch = true;   // Read the subdirectories of the listed directory in background (needs listing_threads != 1)
+	size_t extract_chunk_size = 4 * 1024 * 1024; // Bytes read and written at once when extracting contiguous clusters
+	bool zero_copy_extract = true;       // Let the host copy the file ranges from the image (copy_file_range), where supported
+	size_t extract_buffers = 2;          // Chunks in flight: image is read into one buffer while other is written, 1 -- no overlap
+	size_t probe_cache_ttl_ms = 5000;    // Image layout found by CanYouHandleThisFile() is reused by OpenArchive() etc., 0 -- disabled
+	bool listing_cache = true;           // Keep the listings of the large images on disk, so reopening them does not read the tree
+	size_t listing_cache_min_entries = 1000;        // Smaller listings are not worth it
+	size_t listing_cache_max_files = 100;           // The least recently written cache files above it are removed, 0 -- no limit
+	minimal_fixed_string_t<MAX_PATH> listing_cache_dir; // Empty -- system temporary directory
+
 	//! Enum is not convenient here because of I/O
 	static constexpr int NO_DEBUG     = 0;
 	static constexpr int DEBUGGER_MSG = 1;
@@ -121,7 +141,7 @@ private:
 
 	options_map_t options_map;
 
-	constexpr static const char* inifilename = "\\fatdiskimg.ini";
+	constexpr static const char* inifilename = "fatdiskimg.ini"; // Next to the DefaultIniName
 
 public:
 	template<typename... Args>
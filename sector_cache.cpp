@@ -0,0 +1,287 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "sector_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool sector_cache_t::set_capacity(size_t sectors) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	bool res = true;
+	for (size_t d = 0; d < max_drives; ++d) {
+		res = flush_locked(static_cast<uint8_t>(d)) && res;
+	}
+	drop_all_locked();
+	capacity_m = sectors;
+	slots_m.assign(sectors, slot_t{});
+	data_m.assign(sectors * sector_size, 0);
+	free_slots_m.clear();
+	free_slots_m.reserve(sectors);
+	for (size_t i = sectors; i > 0; --i) {
+		free_slots_m.push_back(static_cast<uint32_t>(i - 1));
+	}
+	index_m.reserve(sectors);
+	return res;
+}
+
+void sector_cache_t::lru_unlink(uint32_t idx) {
+	auto& s = slots_m[idx];
+	if (s.prev != npos)
+		slots_m[s.prev].next = s.next;
+	else
+		lru_head = s.next;
+	if (s.next != npos)
+		slots_m[s.next].prev = s.prev;
+	else
+		lru_tail = s.prev;
+	s.prev = s.next = npos;
+}
+
+void sector_cache_t::lru_push_front(uint32_t idx) {
+	auto& s = slots_m[idx];
+	s.prev = npos;
+	s.next = lru_head;
+	if (lru_head != npos)
+		slots_m[lru_head].prev = idx;
+	lru_head = idx;
+	if (lru_tail == npos)
+		lru_tail = idx;
+}
+
+bool sector_cache_t::write_back(uint32_t idx) {
+	auto& s = slots_m[idx];
+	if (!s.dirty)
+		return true;
+	uint8_t pdrv = key_to_drive(s.key);
+	if (!raw_write(pdrv, slot_data(idx), key_to_sector(s.key), 1))
+		return false;
+	s.dirty = false;
+	++stats_m[pdrv].writebacks;
+	++stats_m[pdrv].host_writes;
+	return true;
+}
+
+bool sector_cache_t::write_back_run(const uint32_t* idxs, size_t count) {
+	if (count == 1)
+		return write_back(idxs[0]);
+	uint64_t first_key = slots_m[idxs[0]].key;
+	uint8_t pdrv = key_to_drive(first_key);
+	gather_list_m.clear();
+	for (size_t i = 0; i < count; ++i) {
+		gather_list_m.push_back(slot_data(idxs[i]));
+	}
+	if (!raw_write_gather(pdrv, gather_list_m.data(), key_to_sector(first_key), count))
+		return false;
+	for (size_t i = 0; i < count; ++i) {
+		slots_m[idxs[i]].dirty = false;
+	}
+	stats_m[pdrv].writebacks += count;
+	++stats_m[pdrv].host_writes;
+	return true;
+}
+
+uint32_t sector_cache_t::get_free_slot() {
+	if (!free_slots_m.empty()) {
+		uint32_t idx = free_slots_m.back();
+		free_slots_m.pop_back();
+		return idx;
+	}
+	uint32_t victim = lru_tail;
+	if (victim == npos)
+		return npos;
+	if (!write_back(victim))
+		return npos;
+	++stats_m[key_to_drive(slots_m[victim].key)].evictions;
+	lru_unlink(victim);
+	index_m.erase(slots_m[victim].key);
+	slots_m[victim].used = false;
+	return victim;
+}
+
+uint32_t sector_cache_t::find(uint8_t pdrv, uint64_t sector) {
+	auto itr = index_m.find(make_key(pdrv, sector));
+	if (itr == index_m.end())
+		return npos;
+	return itr->second;
+}
+
+bool sector_cache_t::insert(uint8_t pdrv, uint64_t sector, const uint8_t* buff, bool dirty) {
+	uint32_t idx = find(pdrv, sector);
+	if (idx != npos) {
+		lru_unlink(idx);
+	}
+	else {
+		idx = get_free_slot();
+		if (idx == npos)
+			return false;
+		auto& s = slots_m[idx];
+		s.key = make_key(pdrv, sector);
+		s.used = true;
+		s.dirty = false;
+		index_m[s.key] = idx;
+	}
+	std::memcpy(slot_data(idx), buff, sector_size);
+	slots_m[idx].dirty = slots_m[idx].dirty || dirty;
+	lru_push_front(idx);
+	return true;
+}
+
+bool sector_cache_t::read(uint8_t pdrv, uint8_t* buff, uint64_t sector, size_t count) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	auto& st = stats_m[pdrv];
+	if (capacity_m == 0) {
+		return raw_read(pdrv, buff, sector, count);
+	}
+	if (count > max_cached_request) {
+		// Image content could be stale for the dirty sectors -- overlay them
+		if (!raw_read(pdrv, buff, sector, count))
+			return false;
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t idx = find(pdrv, sector + i);
+			if (idx != npos && slots_m[idx].dirty)
+				std::memcpy(buff + i * sector_size, slot_data(idx), sector_size);
+		}
+		return true;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t* cur_buff = buff + i * sector_size;
+		uint32_t idx = find(pdrv, sector + i);
+		if (idx != npos) {
+			++st.hits;
+			std::memcpy(cur_buff, slot_data(idx), sector_size);
+			lru_unlink(idx);
+			lru_push_front(idx);
+			continue;
+		}
+		++st.misses;
+		if (!raw_read(pdrv, cur_buff, sector + i, 1))
+			return false;
+		insert(pdrv, sector + i, cur_buff, false); // Failure to cache is not an error
+	}
+	return true;
+}
+
+bool sector_cache_t::write(uint8_t pdrv, const uint8_t* buff, uint64_t sector, size_t count) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	if (capacity_m == 0) {
+		return raw_write(pdrv, buff, sector, count);
+	}
+	if (count > max_cached_request) {
+		if (!raw_write(pdrv, buff, sector, count))
+			return false;
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t idx = find(pdrv, sector + i);
+			if (idx != npos) {
+				std::memcpy(slot_data(idx), buff + i * sector_size, sector_size);
+				slots_m[idx].dirty = false;
+			}
+		}
+		return true;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		const uint8_t* cur_buff = buff + i * sector_size;
+		if (!insert(pdrv, sector + i, cur_buff, true)) {
+			// No slot available (dirty victim failed) -- write through
+			if (!raw_write(pdrv, cur_buff, sector + i, 1))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool sector_cache_t::flush_locked(uint8_t pdrv) {
+	flush_list_m.clear();
+	for (uint32_t idx = 0; idx < slots_m.size(); ++idx) {
+		const auto& s = slots_m[idx];
+		if (s.used && s.dirty && key_to_drive(s.key) == pdrv) {
+			flush_list_m.push_back(idx);
+		}
+	}
+	std::sort(flush_list_m.begin(), flush_list_m.end(),
+		[this](uint32_t a, uint32_t b) { return slots_m[a].key < slots_m[b].key; });
+
+	bool res = true;
+	size_t run_start = 0;
+	for (size_t i = 1; i <= flush_list_m.size(); ++i) {
+		if (i == flush_list_m.size() ||
+			slots_m[flush_list_m[i]].key != slots_m[flush_list_m[i - 1]].key + 1) {
+			res = write_back_run(flush_list_m.data() + run_start, i - run_start) && res;
+			run_start = i;
+		}
+	}
+	return res;
+}
+
+bool sector_cache_t::flush(uint8_t pdrv) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	return flush_locked(pdrv);
+}
+
+bool sector_cache_t::drop_drive(uint8_t pdrv) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	bool res = flush_locked(pdrv);
+	for (uint32_t idx = 0; idx < slots_m.size(); ++idx) {
+		auto& s = slots_m[idx];
+		if (s.used && key_to_drive(s.key) == pdrv) {
+			// Unflushed sector is lost anyway -- the image is being closed
+			free_slot(idx);
+		}
+	}
+	return res;
+}
+
+void sector_cache_t::discard(uint8_t pdrv, uint64_t sector, uint64_t count) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	if (capacity_m == 0)
+		return;
+	if (count <= capacity_m) {
+		for (uint64_t i = 0; i < count; ++i) {
+			uint32_t idx = find(pdrv, sector + i);
+			if (idx != npos)
+				free_slot(idx);
+		}
+		return;
+	}
+	// Range is larger than the cache (whole volume trim by f_mkfs) -- scan the slots instead
+	for (uint32_t idx = 0; idx < slots_m.size(); ++idx) {
+		const auto& s = slots_m[idx];
+		if (s.used && key_to_drive(s.key) == pdrv &&
+			key_to_sector(s.key) >= sector && key_to_sector(s.key) - sector < count) {
+			free_slot(idx);
+		}
+	}
+}
+
+void sector_cache_t::free_slot(uint32_t idx) {
+	auto& s = slots_m[idx];
+	lru_unlink(idx);
+	index_m.erase(s.key);
+	s.used = false;
+	s.dirty = false;
+	free_slots_m.push_back(idx);
+}
+
+void sector_cache_t::drop_all_locked() {
+	slots_m.clear();
+	data_m.clear();
+	free_slots_m.clear();
+	index_m.clear();
+	lru_head = lru_tail = npos;
+}
+
+sector_cache_t::stats_t sector_cache_t::get_stats(uint8_t pdrv) const {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	return stats_m[pdrv];
+}
+
+void sector_cache_t::reset_stats(uint8_t pdrv) {
+	std::lock_guard<std::mutex> lock(cache_mux);
+	stats_m[pdrv] = stats_t{};
+}
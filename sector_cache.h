@@ -0,0 +1,117 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef SECTOR_CACHE_H_INCLUDED
+#define SECTOR_CACHE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+//! Write-back LRU cache of the image sectors, placed under the FatFS disk_* glue.
+//! FatFS works through the single-sector fs->win window, so FAT sectors (put_fat()/get_fat())
+//! and directory sectors (dir_find()) are re-read and re-written over and over -- this cache absorbs it.
+//! Keyed by (pdrv, LBA). Dirty sectors are written to the image on flush() (CTRL_SYNC),
+//! on drop_drive() (disk_deinitialize) or when evicted. On flush, dirty sectors are sorted and
+//! adjacent ones are merged into runs, each written by a single gathering write.
+class sector_cache_t {
+public:
+	static constexpr size_t sector_size = 512;
+
+	//! Raw I/O for the given physical drive, provided by the diskio.cpp. Return true on success.
+	using raw_read_fn_t  = bool(*)(uint8_t pdrv, uint8_t* buff, uint64_t sector, size_t count);
+	using raw_write_fn_t = bool(*)(uint8_t pdrv, const uint8_t* buff, uint64_t sector, size_t count);
+	//! Writes count consecutive sectors, each from its own buffer
+	using raw_write_gather_fn_t = bool(*)(uint8_t pdrv, const uint8_t* const* buffs, uint64_t sector, size_t count);
+
+	struct stats_t {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t writebacks = 0;   // Sectors written to the image
+		size_t host_writes = 0;  // Write calls issued for them; writebacks - host_writes were saved by coalescing
+		size_t evictions = 0;
+	};
+
+	sector_cache_t(raw_read_fn_t rd, raw_write_fn_t wr, raw_write_gather_fn_t wr_g) :
+		raw_read(rd), raw_write(wr), raw_write_gather(wr_g) {}
+
+	//! Capacity in sectors, 0 disables caching. Changing it flushes and drops everything.
+	bool set_capacity(size_t sectors);
+	size_t get_capacity() const { return capacity_m; }
+
+	bool read(uint8_t pdrv, uint8_t* buff, uint64_t sector, size_t count);
+	bool write(uint8_t pdrv, const uint8_t* buff, uint64_t sector, size_t count);
+	//! Write all dirty sectors of the drive to the image
+	bool flush(uint8_t pdrv);
+	//! Flush and forget all sectors of the drive
+	bool drop_drive(uint8_t pdrv);
+	//! Forget the sectors without writing them back, even dirty ones -- their content is no longer needed (CTRL_TRIM)
+	void discard(uint8_t pdrv, uint64_t sector, uint64_t count);
+
+	stats_t get_stats(uint8_t pdrv) const;
+	void reset_stats(uint8_t pdrv);
+
+	//! Requests larger than this go directly to the image (keeping cache coherent) --
+	//! bulk file data would only wash out FAT and directory sectors.
+	static constexpr size_t max_cached_request = 8;
+
+private:
+	static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+	static constexpr size_t max_drives = 256;
+
+	struct slot_t {
+		uint64_t key = 0;
+		uint32_t prev = npos; // LRU list, head is the most recently used
+		uint32_t next = npos;
+		bool dirty = false;
+		bool used = false;
+	};
+
+	static uint64_t make_key(uint8_t pdrv, uint64_t sector) {
+		return (static_cast<uint64_t>(pdrv) << 56) | (sector & 0x00FF'FFFF'FFFF'FFFFull);
+	}
+	static uint8_t key_to_drive(uint64_t key) { return static_cast<uint8_t>(key >> 56); }
+	static uint64_t key_to_sector(uint64_t key) { return key & 0x00FF'FFFF'FFFF'FFFFull; }
+
+	uint8_t* slot_data(uint32_t idx) { return data_m.data() + static_cast<size_t>(idx) * sector_size; }
+
+	void lru_unlink(uint32_t idx);
+	void lru_push_front(uint32_t idx);
+	//! Returns free or evicted slot, npos if dirty victim could not be written
+	uint32_t get_free_slot();
+	uint32_t find(uint8_t pdrv, uint64_t sector);
+	//! Put sector into the cache, marking it dirty if required
+	bool insert(uint8_t pdrv, uint64_t sector, const uint8_t* buff, bool dirty);
+	bool write_back(uint32_t idx);
+	bool write_back_run(const uint32_t* idxs, size_t count);
+	bool flush_locked(uint8_t pdrv);
+	void drop_all_locked();
+	void free_slot(uint32_t idx);
+
+	raw_read_fn_t  raw_read;
+	raw_write_fn_t raw_write;
+	raw_write_gather_fn_t raw_write_gather;
+	std::vector<uint32_t> flush_list_m; // Reused between flushes
+	std::vector<const uint8_t*> gather_list_m;
+
+	size_t capacity_m = 0;
+	std::vector<slot_t>  slots_m;
+	std::vector<uint8_t> data_m;
+	std::vector<uint32_t> free_slots_m;
+	std::unordered_map<uint64_t, uint32_t> index_m;
+	uint32_t lru_head = npos;
+	uint32_t lru_tail = npos;
+
+	stats_t stats_m[max_drives];
+	mutable std::mutex cache_mux;
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include <cassert>
 #include <stdexcept>
 #include <type_traits>
+#include <limits>
 
 // #define  STRING_TOOLS_USE_STRINGSTREAM 
 #ifdef STRING_TOOLS_USE_STRINGSTREAM
@@ -36,6 +37,13 @@ auto from_str(const std::string& arg){
     else if constexpr (std::is_same_v<T, unsigned int>) {
         res = std::stoul(arg, &last_sym);
     }
+    else if constexpr (std::is_unsigned_v<T>) { // size_t is unsigned long on the LP64 hosts
+        auto value = std::stoull(arg, &last_sym);
+        if (value > std::numeric_limits<T>::max()) {
+            throw std::out_of_range{ "Value is out of range: " + arg };
+        }
+        res = static_cast<T>(value);
+    }
     else if constexpr (std::is_same_v<T, std::remove_cvref_t<decltype(arg)>>) {
         return arg; 
     }
@@ -0,0 +1,548 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+//! POSIX implementation of the sysio_winapi.h interface.
+//! Used for profiling and benchmarking the plugin core on the Linux hosts -- TCmd itself is Windows-only.
+
+#include "sysio_winapi.h"
+#include "codepage.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#endif 
+
+namespace {
+	// Same values as the FAT and Windows FILE_ATTRIBUTE_* -- callers rely on this
+	constexpr uint32_t attr_readonly  = 0x01;
+	constexpr uint32_t attr_hidden    = 0x02;
+	constexpr uint32_t attr_system    = 0x04;
+	constexpr uint32_t attr_directory = 0x10;
+	constexpr uint32_t attr_archive   = 0x20;
+	constexpr uint32_t invalid_attributes = static_cast<uint32_t>(-1);
+
+	uint16_t tm_to_FAT_date(const std::tm& t) {
+		return static_cast<uint16_t>(((t.tm_year + 1900 - 1980) << 9) | ((t.tm_mon + 1) << 5) | t.tm_mday);
+	}
+
+	uint16_t tm_to_FAT_time(const std::tm& t) {
+		return static_cast<uint16_t>((t.tm_hour << 11) | (t.tm_min << 5) | (t.tm_sec / 2));
+	}
+}
+
+bool file_exists(const char* path) {
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+	return !S_ISDIR(st.st_mode);
+}
+
+bool create_sized_file(const char* path, uint64_t size, uint8_t fill_byte) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+
+	const size_t chunk_size = 1024 * 1024;
+	std::unique_ptr<uint8_t[]> buffer{ new(std::nothrow) uint8_t[chunk_size] };
+	if (!buffer) {
+		close(fd);
+		return false;
+	}
+	memset(buffer.get(), fill_byte, chunk_size);
+
+	uint64_t total_written = 0;
+	while (total_written < size) {
+		size_t to_write = static_cast<size_t>(std::min<uint64_t>(chunk_size, size - total_written));
+		ssize_t written = write(fd, buffer.get(), to_write);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return false;
+		}
+		total_written += static_cast<size_t>(written);
+	}
+
+	close(fd);
+	return true;
+}
+
+bool create_sparse_file(const char* path, uint64_t size) {
+	if (size > static_cast<uint64_t>(std::numeric_limits<off_t>::max()))
+		return false;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+	bool res = ftruncate(fd, static_cast<off_t>(size)) == 0;
+	close(fd);
+	return res;
+}
+
+// -1 on error
+file_handle_t open_file_shared_read(const char* filename) {
+	return open(filename, O_RDONLY);
+}
+
+//! Opens for reading but allows writing by others -- there are no mandatory locks on POSIX anyway
+file_handle_t open_file_read_shared_write(const char* filename) {
+	return open(filename, O_RDONLY);
+}
+
+file_handle_t open_file_read_write(const char* filename) {
+	return open(filename, O_RDWR);
+}
+
+file_handle_t open_file_write(const char* filename) {
+	// No O_APPEND: copy_file_range() rejects such destinations with EBADF
+	return open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+}
+
+file_handle_t open_file_overwrite(const char* filename) {
+	return open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+//! Returns true if success
+bool close_file(file_handle_t handle) {
+	if (handle < 0)
+		return true;
+	return close(handle) == 0;
+}
+
+bool flush_file(file_handle_t handle) {
+	return fsync(handle) == 0;
+}
+
+bool delete_file(const char* filename) {
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return false;
+	// Read-only attribute does not prevent deletion on POSIX
+	return unlink(filename) == 0;
+}
+
+bool delete_dir(const char* filename)
+{
+	return rmdir(filename) == 0;
+}
+
+bool get_temp_filename(char* buff, const char prefix[]) {
+	const char* tmp_dir = std::getenv("TMPDIR");
+	if (tmp_dir == nullptr || *tmp_dir == '\0')
+		tmp_dir = "/tmp";
+	// Like GetTempFileName(), uses only 3 bytes of the prefix and creates the file
+	int res = snprintf(buff, MAX_PATH, "%s/%.3sXXXXXX", tmp_dir, prefix);
+	if (res < 0 || res >= MAX_PATH)
+		return false;
+	int fd = mkstemp(buff);
+	if (fd == -1)
+		return false;
+	close(fd);
+	return true;
+}
+
+bool get_temp_dir(char* buff) {
+	const char* tmp_dir = std::getenv("TMPDIR");
+	if (tmp_dir == nullptr || *tmp_dir == '\0')
+		tmp_dir = "/tmp";
+	size_t len = strlen(tmp_dir);
+	int res = snprintf(buff, MAX_PATH, "%s%s", tmp_dir, (tmp_dir[len - 1] == '/') ? "" : "/");
+	return res > 0 && res < MAX_PATH;
+}
+
+//! Returns true if success
+bool set_file_pointer(file_handle_t handle, uint64_t offset) {
+	return lseek(handle, static_cast<off_t>(offset), SEEK_SET) != static_cast<off_t>(-1);
+}
+
+size_t read_file(file_handle_t handle, void* buffer_ptr, size_t size) {
+	ssize_t result;
+	do {
+		result = read(handle, buffer_ptr, size);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0) {
+		return static_cast<size_t>(-1);
+	}
+	return static_cast<size_t>(result);
+}
+
+size_t write_file(file_handle_t handle, const void* buffer_ptr, size_t size) {
+	ssize_t result;
+	do {
+		result = write(handle, buffer_ptr, size);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0) {
+		return static_cast<size_t>(-1);
+	}
+	return static_cast<size_t>(result);
+}
+
+size_t read_file_at(file_handle_t handle, void* buffer_ptr, size_t size, uint64_t offset) {
+	size_t total = 0;
+	auto buff = static_cast<char*>(buffer_ptr);
+	while (total < size) {
+		ssize_t result = pread(handle, buff + total, size - total, static_cast<off_t>(offset + total));
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			return static_cast<size_t>(-1);
+		}
+		if (result == 0) // EOF
+			break;
+		total += static_cast<size_t>(result);
+	}
+	return total;
+}
+
+size_t write_file_at(file_handle_t handle, const void* buffer_ptr, size_t size, uint64_t offset) {
+	size_t total = 0;
+	auto buff = static_cast<const char*>(buffer_ptr);
+	while (total < size) {
+		ssize_t result = pwrite(handle, buff + total, size - total, static_cast<off_t>(offset + total));
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			return static_cast<size_t>(-1);
+		}
+		if (result == 0)
+			break;
+		total += static_cast<size_t>(result);
+	}
+	return total;
+}
+
+size_t write_file_gather_at(file_handle_t handle, const io_segment_t* segments, size_t segments_n, uint64_t offset) {
+	size_t total = 0;
+	size_t seg_idx = 0;
+	size_t seg_pos = 0; // Already written part of the segments[seg_idx]
+	std::vector<iovec> iov;
+	iov.reserve(std::min<size_t>(segments_n, IOV_MAX));
+	while (seg_idx < segments_n) {
+		iov.clear();
+		for (size_t i = seg_idx; i < segments_n && iov.size() < IOV_MAX; ++i) {
+			size_t skip = (i == seg_idx) ? seg_pos : 0;
+			iov.push_back({ const_cast<char*>(static_cast<const char*>(segments[i].data)) + skip, segments[i].size - skip });
+		}
+		ssize_t result = pwritev(handle, iov.data(), static_cast<int>(iov.size()), static_cast<off_t>(offset + total));
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			return static_cast<size_t>(-1);
+		}
+		if (result == 0)
+			break;
+		total += static_cast<size_t>(result);
+		// Advance over the fully written segments, partial writes are possible
+		size_t left = static_cast<size_t>(result);
+		while (left > 0 && seg_idx < segments_n) {
+			size_t seg_left = segments[seg_idx].size - seg_pos;
+			if (left >= seg_left) {
+				left -= seg_left;
+				++seg_idx;
+				seg_pos = 0;
+			}
+			else {
+				seg_pos += left;
+				left = 0;
+			}
+		}
+		while (seg_idx < segments_n && segments[seg_idx].size == 0)
+			++seg_idx;
+	}
+	return total;
+}
+
+namespace {
+	//! Network and FUSE filesystems by the statfs() magic numbers; removable media are not distinguished here
+	bool is_on_local_fs(int handle) {
+#if defined(__linux__)
+		struct statfs fs_info;
+		if (fstatfs(handle, &fs_info) != 0)
+			return false;
+		switch (static_cast<unsigned long>(fs_info.f_type)) {
+		case 0x6969:     // NFS
+		case 0x517B:     // SMB
+		case 0xFF534D42: // CIFS
+		case 0xFE534D42: // SMB2
+		case 0x65735546: // FUSE
+			return false;
+		default:
+			return true;
+		}
+#else
+		(void)handle;
+		return true;
+#endif 
+	}
+}
+
+bool map_file_read_only(file_handle_t handle, uint64_t size, file_mapping_t& mapping) {
+	if (size == 0 || size > std::numeric_limits<size_t>::max())
+		return false;
+	if (!is_on_local_fs(handle))
+		return false;
+	void* ptr = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, handle, 0);
+	if (ptr == MAP_FAILED)
+		return false;
+	mapping.data = static_cast<const uint8_t*>(ptr);
+	mapping.size = size;
+	return true;
+}
+
+void unmap_file(file_mapping_t& mapping) {
+	if (mapping.data)
+		munmap(const_cast<uint8_t*>(mapping.data), static_cast<size_t>(mapping.size));
+	mapping = file_mapping_t{};
+}
+
+bool punch_hole(file_handle_t handle, uint64_t offset, uint64_t size) {
+	if (size == 0)
+		return true;
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+	if (offset > static_cast<uint64_t>(std::numeric_limits<off_t>::max()) ||
+		size > static_cast<uint64_t>(std::numeric_limits<off_t>::max()) - offset)
+		return false;
+	return fallocate(handle, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		static_cast<off_t>(offset), static_cast<off_t>(size)) == 0;
+#else
+	(void)handle; (void)offset;
+	return false;
+#endif
+}
+
+size_t copy_file_range_at(file_handle_t src, uint64_t src_offset, file_handle_t dst, size_t size) {
+	size_t total = 0;
+#if defined(__linux__)
+	while (total < size) {
+		if (src_offset + total > static_cast<uint64_t>(std::numeric_limits<off_t>::max()))
+			break;
+		off_t off_in = static_cast<off_t>(src_offset + total);
+		// Kernel uses reflink, if the filesystem supports it, and falls back to the in-kernel copy
+		ssize_t result = copy_file_range(src, &off_in, dst, nullptr, size - total, 0);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EBADF) // Wrong open mode of the handles, not the lack of support
+				debug_print("copy_file_range() failed with EBADF, check the open flags\n");
+			break; // EXDEV, ENOSYS, EINVAL etc. -- not supported for these files
+		}
+		if (result == 0) // EOF
+			break;
+		total += static_cast<size_t>(result);
+	}
+#else
+	(void)src; (void)src_offset; (void)dst; (void)size;
+#endif
+	return total;
+}
+
+bool set_file_datetime(file_handle_t handle, uint32_t file_datetime)
+{
+	// DOS date and time are local
+	uint16_t date = static_cast<uint16_t>(file_datetime >> 16);
+	uint16_t time = static_cast<uint16_t>(file_datetime & 0xFFFF);
+	std::tm t{};
+	t.tm_year = ((date >> 9) & 0x7F) + 1980 - 1900;
+	t.tm_mon  = ((date >> 5) & 0x0F) - 1;
+	t.tm_mday = date & 0x1F;
+	t.tm_hour = (time >> 11) & 0x1F;
+	t.tm_min  = (time >> 5) & 0x3F;
+	t.tm_sec  = (time & 0x1F) * 2;
+	t.tm_isdst = -1;
+	struct timespec times[2];
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT; // Access time
+	times[1].tv_sec = mktime(&t);
+	times[1].tv_nsec = 0;
+	if (times[1].tv_sec == static_cast<time_t>(-1))
+		return false;
+	return futimens(handle, times) == 0;
+}
+
+std::pair<uint16_t, uint16_t> get_file_datatime_for_FatFS(const char* filename) {
+	struct stat st;
+	if (stat(filename, &st) != 0) {
+		return { -1, -1 };
+	}
+	std::tm t{};
+	localtime_r(&st.st_mtime, &t);
+	return { tm_to_FAT_date(t), tm_to_FAT_time(t) };
+}
+
+uint32_t get_current_datatime_for_FatFS() {
+	std::time_t now = std::time(nullptr);
+	std::tm t{};
+	localtime_r(&now, &t);
+	return (static_cast<uint32_t>(tm_to_FAT_date(t)) << 16) | tm_to_FAT_time(t);
+}
+
+bool set_file_attributes(const char* filename, uint32_t attribute) {
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return false;
+	// Only read-only attribute has a POSIX counterpart
+	mode_t mode = st.st_mode & 07777;
+	if (attribute & attr_readonly)
+		mode &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
+	else
+		mode |= S_IWUSR;
+	return chmod(filename, mode) == 0;
+}
+
+uint32_t get_file_attributes(const char* filename)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return invalid_attributes;
+	uint32_t attr = 0;
+	if (S_ISDIR(st.st_mode))
+		attr |= attr_directory;
+	else
+		attr |= attr_archive;
+	if (!(st.st_mode & S_IWUSR))
+		attr |= attr_readonly;
+	const char* name = strrchr(filename, '/');
+	name = name ? name + 1 : filename;
+	if (name[0] == '.' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+		attr |= attr_hidden;
+	return attr;
+}
+
+bool is_dir(const char* filename)
+{
+	auto res = get_file_attributes(filename);
+	if (res == invalid_attributes)
+		return false;
+	return res & attr_directory;
+}
+
+bool check_is_RO(uint32_t attr) {
+	return attr & attr_readonly;
+}
+
+bool check_is_Hidden(uint32_t attr) {
+	return attr & attr_hidden;
+}
+
+bool check_is_System(uint32_t attr) {
+	return attr & attr_system;
+}
+
+bool check_is_Archive(uint32_t attr) {
+	return attr & attr_archive;
+}
+
+uint64_t get_file_size(const char* filename)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return -1;
+	return static_cast<uint64_t>(st.st_size);
+}
+
+uint64_t get_file_size(file_handle_t handle)
+{
+	struct stat st;
+	if (fstat(handle, &st) != 0)
+		return -1;
+	return static_cast<uint64_t>(st.st_size);
+}
+
+uint64_t get_file_mtime(file_handle_t handle)
+{
+	struct stat st;
+	if (fstat(handle, &st) != 0)
+		return 0;
+	return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1'000'000'000u + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+}
+
+bool list_dir_files(const char* dir, const char* prefix, const char* suffix, std::vector<dir_file_info_t>& files) {
+	DIR* dir_ptr = opendir(dir);
+	if (dir_ptr == nullptr)
+		return false;
+	const size_t prefix_len = std::strlen(prefix), suffix_len = std::strlen(suffix);
+	bool ok = true;
+	try {
+		std::string path{ dir };
+		if (!path.empty() && path.back() != '/')
+			path.push_back('/');
+		const size_t dir_len = path.size();
+		while (const dirent* entry = readdir(dir_ptr)) {
+			const size_t name_len = std::strlen(entry->d_name);
+			if (name_len < prefix_len + suffix_len || std::strncmp(entry->d_name, prefix, prefix_len) != 0 ||
+				std::strcmp(entry->d_name + name_len - suffix_len, suffix) != 0)
+				continue;
+			path.resize(dir_len);
+			path.append(entry->d_name);
+			struct stat st;
+			if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+				continue;
+			dir_file_info_t info;
+			info.name = entry->d_name;
+			info.size = static_cast<uint64_t>(st.st_size);
+			info.mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1'000'000'000u + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+			files.push_back(std::move(info));
+		}
+	}
+	catch (std::bad_alloc&) {
+		ok = false;
+	}
+	closedir(dir_ptr);
+	return ok;
+}
+
+uint32_t get_current_datetime()
+{
+	// GetSystemTime() on Windows -- UTC
+	std::time_t now = std::time(nullptr);
+	std::tm t{};
+	gmtime_r(&now, &t);
+	return (static_cast<uint32_t>(tm_to_FAT_date(t)) << 16) + tm_to_FAT_time(t);
+}
+
+namespace {
+	//! ASCII-only for now, other symbols are replaced by '?', as WideCharToMultiByte() does for unmappable ones.
+	const codepage_table_t* get_ANSI_table() {
+		static const codepage_table_t table;
+		return &table;
+	}
+}
+
+char simple_ucs16_to_local(wchar_t wc) {
+	return get_ANSI_table()->to_local(wc);
+}
+
+int ucs16_to_local(char* outstr, size_t outsize, const wchar_t* instr, size_t inlen) {
+	if (instr != nullptr) {
+		if (inlen == 0) // WideCharToMultiByte() fails on the empty input
+			return 1;
+		if (inlen > outsize)
+			return ERANGE;
+		get_ANSI_table()->convert(outstr, instr, inlen);
+		return 0;
+	}
+	else {
+		return 1;
+	}
+}
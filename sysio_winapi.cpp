@@ -13,6 +13,12 @@
 * hesitate to send me an email.
 */
 #include "sysio_winapi.h"
+#include "codepage.h"
+#include <winioctl.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
 
 
 bool file_exists(const char* path) {
@@ -20,7 +26,7 @@ bool file_exists(const char* path) {
 	return (attr != INVALID_FILE_ATTRIBUTES && !(attr & FILE_ATTRIBUTE_DIRECTORY));
 }
 
-bool create_sized_file(const char* path, size_t size, uint8_t fill_byte) {
+bool create_sized_file(const char* path, uint64_t size, uint8_t fill_byte) {
 	HANDLE hFile = CreateFileA(
 		path,
 		GENERIC_WRITE,
@@ -35,15 +41,19 @@ bool create_sized_file(const char* path, size_t size, uint8_t fill_byte) {
 		return false;
 
 	const size_t chunk_size = 1024*1024;
-	uint8_t* buffer = new uint8_t[chunk_size];
-	memset(buffer, fill_byte, chunk_size);
+	std::unique_ptr<uint8_t[]> buffer{ new(std::nothrow) uint8_t[chunk_size] };
+	if (!buffer) {
+		CloseHandle(hFile);
+		return false;
+	}
+	memset(buffer.get(), fill_byte, chunk_size);
 
 	DWORD written = 0;
-	size_t total_written = 0;
+	uint64_t total_written = 0;
 
 	while (total_written < size) {
-		DWORD to_write = static_cast<DWORD>(std::min(chunk_size, size - total_written));
-		if (!WriteFile(hFile, buffer, to_write, &written, nullptr)) {
+		DWORD to_write = static_cast<DWORD>(std::min<uint64_t>(chunk_size, size - total_written));
+		if (!WriteFile(hFile, buffer.get(), to_write, &written, nullptr)) {
 			CloseHandle(hFile);
 			return false;
 		}
@@ -54,6 +64,22 @@ bool create_sized_file(const char* path, size_t size, uint8_t fill_byte) {
 	return true;
 }
 
+bool create_sparse_file(const char* path, uint64_t size) {
+	HANDLE hFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	// Failure is not an error: FAT/exFAT hosts have no sparse files, but extending is still fast there
+	DWORD returned = 0;
+	FILE_SET_SPARSE_BUFFER sparse{ TRUE };
+	DeviceIoControl(hFile, FSCTL_SET_SPARSE, &sparse, sizeof(sparse), nullptr, 0, &returned, nullptr);
+
+	LARGE_INTEGER li;
+	li.QuadPart = static_cast<LONGLONG>(size);
+	bool res = SetFilePointerEx(hFile, li, nullptr, FILE_BEGIN) && SetEndOfFile(hFile);
+	CloseHandle(hFile);
+	return res;
+}
+
 // INVALID_HANDLE_VALUE on error
 file_handle_t open_file_shared_read(const char* filename) {
 	file_handle_t handle;
@@ -68,6 +94,13 @@ file_handle_t open_file_read_shared_write(const char* filename) {
 	return handle;
 }
 
+//! Opens existing file for in-place modification, keeping it accessible to other readers and writers
+file_handle_t open_file_read_write(const char* filename) {
+	file_handle_t handle;
+	handle = CreateFile(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	return handle;
+}
+
 file_handle_t open_file_write(const char* filename) {
 	file_handle_t handle;
 	handle = CreateFile(filename, GENERIC_WRITE | FILE_APPEND_DATA, FILE_SHARE_READ, 0, CREATE_NEW, 0, 0);
@@ -135,8 +168,13 @@ bool get_temp_filename(char* buff, const char prefix[]) {
 	return true;
 }
 
+bool get_temp_dir(char* buff) {
+	auto dwRetVal = GetTempPath(MAX_PATH, buff); // With the trailing backslash
+	return dwRetVal != 0 && dwRetVal < MAX_PATH;
+}
+
 //! Returns true if success
-bool set_file_pointer(file_handle_t handle, size_t offset) {
+bool set_file_pointer(file_handle_t handle, uint64_t offset) {
 	LARGE_INTEGER offs;
 	offs.QuadPart = offset;
 	return SetFilePointerEx(handle, offs, nullptr, FILE_BEGIN);
@@ -166,6 +204,140 @@ size_t write_file(file_handle_t handle, const void* buffer_ptr, size_t size) {
 	}
 }
 
+size_t read_file_at(file_handle_t handle, void* buffer_ptr, size_t size, uint64_t offset) {
+	// Synchronous handle + OVERLAPPED -- reads from the given offset without separate SetFilePointerEx call
+	size_t total = 0;
+	auto buff = static_cast<char*>(buffer_ptr);
+	while (total < size) {
+		OVERLAPPED ovl{};
+		uint64_t cur_offset = offset + total;
+		ovl.Offset = static_cast<DWORD>(cur_offset & 0xFFFF'FFFF);
+		ovl.OffsetHigh = static_cast<DWORD>(cur_offset >> 32);
+		DWORD to_read = static_cast<DWORD>(std::min<size_t>(size - total, 1024 * 1024 * 1024));
+		DWORD result = 0;
+		if (!ReadFile(handle, buff + total, to_read, &result, &ovl)) { //-V2001
+			if (GetLastError() == ERROR_HANDLE_EOF)
+				break;
+			return static_cast<size_t>(-1);
+		}
+		if (result == 0)
+			break;
+		total += result;
+	}
+	return total;
+}
+
+size_t write_file_at(file_handle_t handle, const void* buffer_ptr, size_t size, uint64_t offset) {
+	size_t total = 0;
+	auto buff = static_cast<const char*>(buffer_ptr);
+	while (total < size) {
+		OVERLAPPED ovl{};
+		uint64_t cur_offset = offset + total;
+		ovl.Offset = static_cast<DWORD>(cur_offset & 0xFFFF'FFFF);
+		ovl.OffsetHigh = static_cast<DWORD>(cur_offset >> 32);
+		DWORD to_write = static_cast<DWORD>(std::min<size_t>(size - total, 1024 * 1024 * 1024));
+		DWORD result = 0;
+		if (!WriteFile(handle, buff + total, to_write, &result, &ovl)) { //-V2001
+			return static_cast<size_t>(-1);
+		}
+		if (result == 0)
+			break;
+		total += result;
+	}
+	return total;
+}
+
+//! WriteFileGather() requires FILE_FLAG_NO_BUFFERING and page-sized segments, so gather into the
+//! temporary buffer and issue single WriteFile() instead.
+size_t write_file_gather_at(file_handle_t handle, const io_segment_t* segments, size_t segments_n, uint64_t offset) {
+	size_t total_size = 0;
+	for (size_t i = 0; i < segments_n; ++i) {
+		total_size += segments[i].size;
+	}
+	std::unique_ptr<char[]> buffer{ new(std::nothrow) char[total_size] };
+	if (!buffer) { // Fall back to the separate writes
+		size_t total = 0;
+		for (size_t i = 0; i < segments_n; ++i) {
+			auto res = write_file_at(handle, segments[i].data, segments[i].size, offset + total);
+			if (res != segments[i].size)
+				return (res == static_cast<size_t>(-1)) ? res : total + res;
+			total += res;
+		}
+		return total;
+	}
+	size_t pos = 0;
+	for (size_t i = 0; i < segments_n; ++i) {
+		memcpy(buffer.get() + pos, segments[i].data, segments[i].size);
+		pos += segments[i].size;
+	}
+	return write_file_at(handle, buffer.get(), total_size, offset);
+}
+
+namespace {
+	//! Network files have no volume GUID path, for the local ones the volume root is checked.
+	bool is_on_fixed_drive(HANDLE handle) {
+		char path[MAX_PATH];
+		DWORD len = GetFinalPathNameByHandleA(handle, path, MAX_PATH, VOLUME_NAME_GUID);
+		if (len == 0 || len >= MAX_PATH)
+			return false;
+		// "\\?\Volume{GUID}\dir\file" -> "\\?\Volume{GUID}\"
+		char* root_end = std::strchr(path + 4, '\\');
+		if (root_end == nullptr)
+			return false;
+		root_end[1] = '\0';
+		UINT type = GetDriveTypeA(path);
+		return type == DRIVE_FIXED || type == DRIVE_RAMDISK;
+	}
+}
+
+bool map_file_read_only(file_handle_t handle, uint64_t size, file_mapping_t& mapping) {
+	if (size == 0 || size > std::numeric_limits<size_t>::max())
+		return false;
+	if (!is_on_fixed_drive(handle))
+		return false;
+	HANDLE hMap = CreateFileMapping(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (hMap == nullptr)
+		return false;
+	void* ptr = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, static_cast<size_t>(size));
+	if (ptr == nullptr) {
+		CloseHandle(hMap);
+		return false;
+	}
+	mapping.data = static_cast<const uint8_t*>(ptr);
+	mapping.size = size;
+	mapping.mapping_handle = hMap;
+	return true;
+}
+
+void unmap_file(file_mapping_t& mapping) {
+	if (mapping.data)
+		UnmapViewOfFile(mapping.data);
+	if (mapping.mapping_handle)
+		CloseHandle(mapping.mapping_handle);
+	mapping = file_mapping_t{};
+}
+
+bool punch_hole(file_handle_t handle, uint64_t offset, uint64_t size) {
+	if (size == 0)
+		return true;
+	DWORD returned = 0;
+	// Without the sparse attribute FSCTL_SET_ZERO_DATA just writes zeros. Repeated calls are cheap.
+	FILE_SET_SPARSE_BUFFER sparse{ TRUE };
+	if (!DeviceIoControl(handle, FSCTL_SET_SPARSE, &sparse, sizeof(sparse), nullptr, 0, &returned, nullptr))
+		return false;
+	FILE_ZERO_DATA_INFORMATION zero_data;
+	zero_data.FileOffset.QuadPart = static_cast<LONGLONG>(offset);
+	zero_data.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(offset + size);
+	return DeviceIoControl(handle, FSCTL_SET_ZERO_DATA, &zero_data, sizeof(zero_data), nullptr, 0, &returned, nullptr) != 0;
+}
+
+size_t copy_file_range_at(file_handle_t src, uint64_t src_offset, file_handle_t dst, size_t size) {
+	// No general range copy between the files on Windows: FSCTL_DUPLICATE_EXTENTS_TO_FILE is ReFS-only and
+	// requires cluster-aligned ranges, which the FAT clusters inside the image are not in general.
+	(void)src; (void)src_offset; (void)dst; (void)size;
+	return 0;
+}
+
 bool set_file_datetime(file_handle_t handle, uint32_t file_datetime)
 {
 	FILETIME LocTime, GlobTime;
@@ -258,7 +430,7 @@ bool check_is_Archive(uint32_t attr) {
 	return attr & FILE_ATTRIBUTE_ARCHIVE;
 }
 
-size_t get_file_size(const char* filename)
+uint64_t get_file_size(const char* filename)
 {
 	WIN32_FILE_ATTRIBUTE_DATA fad;
 	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &fad))
@@ -269,7 +441,7 @@ size_t get_file_size(const char* filename)
 	return size.QuadPart;
 }
 
-size_t get_file_size(file_handle_t handle)
+uint64_t get_file_size(file_handle_t handle)
 {
 	LARGE_INTEGER size;
 	if (!GetFileSizeEx(handle, &size))
@@ -278,6 +450,48 @@ size_t get_file_size(file_handle_t handle)
 	return size.QuadPart;
 }
 
+uint64_t get_file_mtime(file_handle_t handle)
+{
+	FILETIME write_time;
+	if (!GetFileTime(handle, nullptr, nullptr, &write_time))
+		return 0;
+	return (static_cast<uint64_t>(write_time.dwHighDateTime) << 32) | write_time.dwLowDateTime;
+}
+
+bool list_dir_files(const char* dir, const char* prefix, const char* suffix, std::vector<dir_file_info_t>& files) {
+	char mask[MAX_PATH];
+	const size_t dir_len = std::strlen(dir);
+	const bool need_separator = dir_len > 0 && dir[dir_len - 1] != '\\' && dir[dir_len - 1] != '/';
+	if (snprintf(mask, sizeof(mask), "%s%s%s*%s", dir, need_separator ? "\\" : "", prefix, suffix) >= static_cast<int>(sizeof(mask)))
+		return false;
+	WIN32_FIND_DATAA data;
+	HANDLE hFind = FindFirstFileA(mask, &data);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	const size_t prefix_len = std::strlen(prefix), suffix_len = std::strlen(suffix);
+	do {
+		const size_t name_len = std::strlen(data.cFileName);
+		// Masks are matched against the short names too, so the long ones are checked again
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || name_len < prefix_len + suffix_len ||
+			std::strncmp(data.cFileName, prefix, prefix_len) != 0 ||
+			std::strcmp(data.cFileName + name_len - suffix_len, suffix) != 0)
+			continue;
+		try {
+			dir_file_info_t info;
+			info.name = data.cFileName;
+			info.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			info.mtime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+			files.push_back(std::move(info));
+		}
+		catch (std::bad_alloc&) {
+			FindClose(hFind);
+			return false;
+		}
+	} while (FindNextFileA(hFind, &data));
+	FindClose(hFind);
+	return true;
+}
+
 uint32_t get_current_datetime()
 {
 	SYSTEMTIME t = {0};
@@ -289,18 +503,60 @@ uint32_t get_current_datetime()
 	return (static_cast<uint32_t>(dft[1]) << 16) + dft[0];
 }
 
+namespace {
+	//! The whole BMP is converted by the two WideCharToMultiByte() calls -- surrogates are left out, so each
+	//! symbol gives exactly one byte. nullptr for the multibyte ANSI code pages, they are converted by the API.
+	std::unique_ptr<codepage_table_t> make_ANSI_table() {
+		CPINFO info;
+		if (!GetCPInfo(CP_ACP, &info) || info.MaxCharSize != 1)
+			return nullptr;
+		try {
+			auto table = std::make_unique<codepage_table_t>();
+			auto symbols = std::make_unique<wchar_t[]>(codepage_table_t::table_size);
+			for (size_t i = 0; i < codepage_table_t::table_size; ++i)
+				symbols[i] = static_cast<wchar_t>(i);
+			auto convert_range = [&](size_t first, size_t last) {
+				const int count = static_cast<int>(last - first);
+				return WideCharToMultiByte(CP_ACP, 0, symbols.get() + first, count,
+					table->data() + first, count, NULL, NULL) == count;
+				};
+			if (!convert_range(0x80, 0xD800) || !convert_range(0xE000, codepage_table_t::table_size))
+				return nullptr;
+			return table;
+		}
+		catch (std::bad_alloc&) {
+			return nullptr;
+		}
+	}
+
+	const codepage_table_t* get_ANSI_table() {
+		static const std::unique_ptr<codepage_table_t> table = make_ANSI_table();
+		return table.get();
+	}
+}
+
 char simple_ucs16_to_local(wchar_t wc) {
+	if (const codepage_table_t* table = get_ANSI_table())
+		return table->to_local(wc);
 	char tc = '\0';
 	WideCharToMultiByte(CP_ACP, 0, &wc, -1, &tc, 1, NULL, NULL); 
 	return tc;
 }
 
-int ucs16_to_local(char* outstr, const wchar_t* instr, size_t maxoutlen) {
+int ucs16_to_local(char* outstr, size_t outsize, const wchar_t* instr, size_t inlen) {
 	if (instr != nullptr) {
+		if (const codepage_table_t* table = get_ANSI_table()) {
+			if (inlen == 0) // WideCharToMultiByte() fails on the empty input
+				return 1;
+			if (inlen > outsize)
+				return ERROR_INSUFFICIENT_BUFFER;
+			table->convert(outstr, instr, inlen);
+			return 0;
+		}
 		// CP_ACP The system default Windows ANSI code page.
 		// TODO: error analysis
-		int res = WideCharToMultiByte(CP_ACP, 0, instr, static_cast<int>(maxoutlen), 
-			                          outstr, static_cast<int>(maxoutlen), NULL, NULL);
+		int res = WideCharToMultiByte(CP_ACP, 0, instr, static_cast<int>(inlen), 
+			                          outstr, static_cast<int>(outsize), NULL, NULL);
 		if (res != 0)
 			return 0;
 		else
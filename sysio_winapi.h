@@ -10,29 +10,87 @@
 #ifndef SYSIO_WINAPI_H_INCLUDED
 #define SYSIO_WINAPI_H_INCLUDED
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
 #include <windows.h>
+#endif 
+#include <cerrno>
 #include <cstdint>
 
 #include <exception>
 #include <cstdio>
+#include <cstring>
+#include <string>
 #include <utility>
+#include <vector>
 
 #ifndef NDEBUG
+#if __has_include(<format>)
 #include <format>
+#define SYSIO_HAS_FORMAT 1
+#endif 
 #endif 
 
+#ifdef _WIN32
 const auto file_open_error_v = INVALID_HANDLE_VALUE;
 using file_handle_t = HANDLE;
+#else
+//! POSIX backend, see sysio_posix.cpp
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif 
+constexpr int file_open_error_v = -1;
+using file_handle_t = int;
+
+inline void OutputDebugString(const char* str) { std::fputs(str, stderr); }
+
+// Windows types and MSVC CRT functions used by the plugin core and wcxhead.h.
+// Integer types match the ones of the FatFS (ff.h), so both headers could be included.
+typedef uint16_t WCHAR;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HINSTANCE;
+#ifndef __stdcall
+#define __stdcall
+#endif 
+
+inline int strcpy_s(char* dest, size_t dest_size, const char* src) {
+	const size_t len = std::strlen(src);
+	if (len >= dest_size) {
+		if (dest_size != 0)
+			dest[0] = '\0';
+		return ERANGE;
+	}
+	std::memcpy(dest, src, len + 1);
+	return 0;
+}
+inline size_t strnlen_s(const char* str, size_t max_len) {
+	return str ? strnlen(str, max_len) : 0;
+}
+inline int memcpy_s(void* dest, size_t dest_size, const void* src, size_t count) {
+	if (count > dest_size)
+		return ERANGE;
+	std::memcpy(dest, src, count);
+	return 0;
+}
+//! No CRT invalid parameter handlers on POSIX -- setting it is a no-op
+typedef void (*_invalid_parameter_handler)(const wchar_t*, const wchar_t*, const wchar_t*, unsigned int, uintptr_t);
+inline _invalid_parameter_handler _set_invalid_parameter_handler(_invalid_parameter_handler) { return nullptr; }
+#endif 
 
 // All functions returning bool returns true on success
 bool file_exists(const char* path);
-bool create_sized_file(const char* path, size_t size, uint8_t fill_byte = 0xFF);
+bool create_sized_file(const char* path, uint64_t size, uint8_t fill_byte = 0xFF);
+//! Creates zero-filled file without writing it -- sparse, if the host filesystem supports it
+bool create_sparse_file(const char* path, uint64_t size);
 file_handle_t open_file_shared_read(const char* filename);
 file_handle_t open_file_read_shared_write(const char* filename);
+file_handle_t open_file_read_write(const char* filename);
 file_handle_t open_file_write(const char* filename);
 file_handle_t open_file_overwrite(const char* filename);
 bool close_file(file_handle_t handle);
@@ -40,9 +98,42 @@ bool flush_file(file_handle_t handle);
 bool delete_file(const char* filename);
 bool delete_dir(const char* filename); // Only for empty directories
 bool get_temp_filename(char* buff, const char prefix[]);
-bool set_file_pointer(file_handle_t handle, size_t offset);
+//! Directory for the temporary files, with the trailing separator; buff should have MAX_PATH bytes
+bool get_temp_dir(char* buff);
+bool set_file_pointer(file_handle_t handle, uint64_t offset);
 size_t read_file(file_handle_t handle, void* buffer_ptr, size_t size);
 size_t write_file(file_handle_t handle, const void* buffer_ptr, size_t size);
+//! Positional I/O: single call instead of set_file_pointer() + read_file()/write_file(). 
+//! Does not rely on the shared file pointer, so could be used by several threads with the same handle.
+//! Note: on Windows the file pointer is moved as a side effect, on POSIX it is left intact.
+size_t read_file_at(file_handle_t handle, void* buffer_ptr, size_t size, uint64_t offset);
+size_t write_file_at(file_handle_t handle, const void* buffer_ptr, size_t size, uint64_t offset);
+//! Gathering write of several buffers, placed contiguously in the file starting from the offset.
+struct io_segment_t {
+	const void* data;
+	size_t size;
+};
+size_t write_file_gather_at(file_handle_t handle, const io_segment_t* segments, size_t segments_n, uint64_t offset);
+//! Read-only view of the whole file. Could fail for the large files on 32-bit builds (address space),
+//! so callers should fall back to read_file_at().
+//! Files on the network shares and removable media are not mapped: an I/O error on a mapped page is
+//! an access violation-like exception (SIGBUS on POSIX), not an error code, and would crash the host process.
+struct file_mapping_t {
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
+#ifdef _WIN32
+	HANDLE mapping_handle = nullptr;
+#endif 
+};
+bool map_file_read_only(file_handle_t handle, uint64_t size, file_mapping_t& mapping);
+void unmap_file(file_mapping_t& mapping);
+//! Deallocates the file range on the host, keeping the file size; the range reads back as zeros.
+//! Partial filesystem blocks at the range ends are zeroed. Fails if the host filesystem does not support it.
+bool punch_hole(file_handle_t handle, uint64_t offset, uint64_t size);
+//! Copies the range of src to the current position of dst inside the kernel, without the user-space buffers
+//! (could be done by reflink or by the server-side copy). Returns the number of bytes copied, which is less
+//! than size if the host does not support it -- the rest should be copied by read/write.
+size_t copy_file_range_at(file_handle_t src, uint64_t src_offset, file_handle_t dst, size_t size);
 bool set_file_datetime(file_handle_t handle, uint32_t file_datetime);
 bool set_file_attributes(const char* filename, uint32_t attribute);
 uint32_t get_file_attributes(const char* filename);
@@ -52,9 +143,23 @@ bool check_is_RO(uint32_t attr);
 bool check_is_Hidden(uint32_t attr);
 bool check_is_System(uint32_t attr);
 bool check_is_Archive(uint32_t attr);
-size_t get_file_size(const char* filename);
-size_t get_file_size(file_handle_t handle);
+//! Returns static_cast<uint64_t>(-1) on error
+uint64_t get_file_size(const char* filename);
+uint64_t get_file_size(file_handle_t handle);
+//! Last modification time in the host units (100 ns on Windows, 1 ns on POSIX) -- only for comparisons; 0 on error
+uint64_t get_file_mtime(file_handle_t handle);
+struct dir_file_info_t {
+	std::string name; // Without the directory
+	uint64_t size = 0;
+	uint64_t mtime = 0; // As get_file_mtime()
+};
+//! Regular files of the directory, whose names start with the prefix and end with the suffix. False on error.
+bool list_dir_files(const char* dir, const char* prefix, const char* suffix, std::vector<dir_file_info_t>& files);
+#ifdef _WIN32
 inline char get_path_separator() { return '\\'; }
+#else
+inline char get_path_separator() { return '/'; }
+#endif 
 
 uint32_t get_current_datetime();
 std::pair<uint16_t, uint16_t> get_file_datatime_for_FatFS(const char* filename);
@@ -62,13 +167,14 @@ uint32_t get_current_datatime_for_FatFS();
 
 //! Very basic, simplistic, function
 char simple_ucs16_to_local(wchar_t wc);
-//! More advenced:
-int ucs16_to_local(char* outstr, const wchar_t* instr, size_t maxoutlen);
+//! More advenced: converts inlen symbols to at most outsize bytes, no terminating zero is added.
+//! Multibyte (DBCS) code pages could need up to two bytes per symbol. Fails if the result does not fit.
+int ucs16_to_local(char* outstr, size_t outsize, const wchar_t* instr, size_t inlen);
 
 // Defect report: https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2023/p2905r2.html disables forwarding and Args&&
 template<typename... Args>
 void debug_print(const char* format, const Args&... args) {
-#ifndef NDEBUG
+#if defined(SYSIO_HAS_FORMAT)
     try {
         std::string strbuf = std::vformat(format, std::make_format_args(args...));
         OutputDebugString(strbuf.c_str()); // Sends a string to the debugger
@@ -77,6 +183,8 @@ void debug_print(const char* format, const Args&... args) {
         OutputDebugString(ex.what()); 
     }
     // See also http://www.nirsoft.net/utils/simple_program_debugger.html
+#elif !defined(NDEBUG)
+    OutputDebugString(format); // Older standard libraries, without <format> -- unformatted
 #endif // !NDEBUG
 }
 
@@ -1,5 +1,8 @@
 #ifndef _WCXHEAD_H_
 #define _WCXHEAD_H_
+#ifndef _WIN32
+#include "sysio_winapi.h" /* WCHAR, DWORD, __stdcall on the non-Windows hosts */
+#endif
 /* Contents of file wcxhead.h */
 /* It contains definitions of error codes, flags and callbacks */
 
@@ -0,0 +1,133 @@
+// This is a personal academic project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+namespace {
+	// Pool and queue of the current thread, so the nested submits go to its own queue
+	thread_local const work_stealing_pool_t* current_pool = nullptr;
+	thread_local size_t current_index = 0;
+}
+
+work_stealing_pool_t::work_stealing_pool_t(size_t threads) {
+	threads = std::max<size_t>(threads, 1);
+	queues_m.reserve(threads);
+	for (size_t i = 0; i < threads; ++i) {
+		queues_m.push_back(std::make_unique<queue_t>());
+	}
+	threads_m.reserve(threads - 1);
+	try {
+		for (size_t i = 1; i < threads; ++i) {
+			threads_m.emplace_back(&work_stealing_pool_t::worker_loop, this, i);
+		}
+	}
+	catch (...) { // Destructor is not called -- the started threads should be joined here
+		stop_and_join();
+		throw;
+	}
+}
+
+work_stealing_pool_t::~work_stealing_pool_t() {
+	stop_and_join();
+}
+
+void work_stealing_pool_t::stop_and_join() {
+	{
+		std::lock_guard<std::mutex> lock(sleep_mux);
+		stop_m = true;
+	}
+	sleep_cv.notify_all();
+	for (auto& t : threads_m) {
+		t.join();
+	}
+	threads_m.clear();
+}
+
+size_t work_stealing_pool_t::default_threads() {
+	// Listing is I/O-bound, more threads than this rarely helps
+	constexpr size_t max_default_threads = 8;
+	size_t hw = std::thread::hardware_concurrency();
+	return std::clamp<size_t>(hw, 1, max_default_threads);
+}
+
+size_t work_stealing_pool_t::current_queue() const {
+	return current_pool == this ? current_index : 0;
+}
+
+void work_stealing_pool_t::submit(task_t task) {
+	auto& queue = *queues_m[current_queue()];
+	pending_m.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(queue.mux);
+		queue.tasks.push_back(std::move(task));
+	}
+	queued_m.fetch_add(1, std::memory_order_release);
+	{ std::lock_guard<std::mutex> lock(sleep_mux); } // Sleeping worker could have checked queued_m just before
+	sleep_cv.notify_one();
+}
+
+bool work_stealing_pool_t::try_run_one(size_t self) {
+	task_t task;
+	{
+		auto& own = *queues_m[self];
+		std::lock_guard<std::mutex> lock(own.mux);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+		}
+	}
+	for (size_t i = 1; !task && i < queues_m.size(); ++i) {
+		auto& victim = *queues_m[(self + i) % queues_m.size()];
+		std::lock_guard<std::mutex> lock(victim.mux);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+		}
+	}
+	if (!task)
+		return false;
+	queued_m.fetch_sub(1, std::memory_order_relaxed);
+	task();
+	if (pending_m.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		{ std::lock_guard<std::mutex> lock(sleep_mux); }
+		sleep_cv.notify_all(); // Wake up wait()
+	}
+	return true;
+}
+
+void work_stealing_pool_t::worker_loop(size_t self) {
+	current_pool = this;
+	current_index = self;
+	while (true) {
+		if (try_run_one(self))
+			continue;
+		std::unique_lock<std::mutex> lock(sleep_mux);
+		sleep_cv.wait(lock, [this] { return stop_m || queued_m.load(std::memory_order_acquire) > 0; });
+		if (stop_m)
+			return;
+	}
+}
+
+void work_stealing_pool_t::wait() {
+	auto prev_pool = current_pool;
+	auto prev_index = current_index;
+	current_pool = this;
+	current_index = 0;
+	while (pending_m.load(std::memory_order_acquire) > 0) {
+		if (try_run_one(0))
+			continue;
+		std::unique_lock<std::mutex> lock(sleep_mux);
+		sleep_cv.wait(lock, [this] {
+			return pending_m.load(std::memory_order_acquire) == 0 || queued_m.load(std::memory_order_acquire) > 0; });
+	}
+	current_pool = prev_pool;
+	current_index = prev_index;
+}
@@ -0,0 +1,67 @@
+/*
+* Floppy disk images unpack plugin for the Total Commander.
+* Copyright (c) 2022-2026, Oleg Farenyuk aka Indrekis ( indrekis@gmail.com )
+*
+* The code is released under the MIT License.
+*/
+
+#pragma once
+
+#ifndef WORK_STEALING_POOL_H_INCLUDED
+#define WORK_STEALING_POOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Pool for the recursive tasks, like directory tree traversal, where each task could submit new ones.
+//! Each worker has its own deque: it takes the newest tasks from its back (depth-first, cache-friendly),
+//! idle workers steal the oldest ones from the front of the others' deques.
+//! The thread calling wait() works as one of the workers, so the pool of N threads starts N-1 threads.
+class work_stealing_pool_t {
+public:
+	using task_t = std::function<void()>;
+
+	//! Throws std::system_error if threads could not be started
+	explicit work_stealing_pool_t(size_t threads);
+	~work_stealing_pool_t();
+	work_stealing_pool_t(const work_stealing_pool_t&) = delete;
+	work_stealing_pool_t& operator=(const work_stealing_pool_t&) = delete;
+
+	//! Could be called from any thread, including the tasks. Tasks should not throw.
+	void submit(task_t task);
+	//! Runs tasks in the calling thread until all submitted ones (including nested) are finished
+	void wait();
+
+	size_t get_threads() const { return queues_m.size(); }
+
+	//! Number of threads for the "0 -- auto" configuration values
+	static size_t default_threads();
+
+private:
+	struct queue_t {
+		std::mutex mux;
+		std::deque<task_t> tasks;
+	};
+
+	bool try_run_one(size_t self);
+	void worker_loop(size_t self);
+	size_t current_queue() const;
+	void stop_and_join();
+
+	std::vector<std::unique_ptr<queue_t>> queues_m; // Index 0 -- for the thread calling wait() and external submits
+	std::vector<std::thread> threads_m;
+	std::atomic<size_t> queued_m{ 0 };  // Submitted, not yet taken
+	std::atomic<size_t> pending_m{ 0 }; // Submitted, not yet finished
+	std::mutex sleep_mux;
+	std::condition_variable sleep_cv;
+	bool stop_m = false;
+};
+
+#endif